@@ -0,0 +1,47 @@
+// Measures append and replay throughput of the offline event journal on LittleFS.
+// Appends RECORDS event payloads, then reads them back the way IotLink replays them.
+
+#include <Arduino.h>
+#include "IotLinkJournal.h"
+
+#define RECORDS 200 // about 48 KB, stays within IOTLINK_JOURNAL_SEGMENTS * IOTLINK_JOURNAL_SEGMENT_SIZE
+
+const char payload[] = "{\"action\":\"currentTemperature\",\"cause\":{\"type\":\"PERIODIC_POLL\"},\"createdAt\":1700000000,"
+                       "\"deviceId\":\"5dc1564130xxxxxxxxxxxxxx\",\"replyToken\":\"6a5f1c2e-4b7d-4e8a-9c3f-0d1e2f3a4b5c\","
+                       "\"type\":\"event\",\"value\":{\"humidity\":48.2,\"temperature\":21.7}}";
+
+IotLinkJournal journal;
+char record[IotLinkJournal::recordHeaderSize + sizeof(payload)]; // append() fills in the header in front of the payload
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  if (!journal.begin("/journal-benchmark")) {
+    Serial.println("journal not available");
+    return;
+  }
+  while (!journal.empty()) { char buffer[512]; journal.peek(buffer, sizeof(buffer)); journal.consume(); }
+
+  memcpy(record + IotLinkJournal::recordHeaderSize, payload, sizeof(payload));
+  unsigned long start = micros();
+  for (int i = 0; i < RECORDS; i++) journal.append(record, sizeof(payload) - 1);
+  unsigned long appendTime = micros() - start;
+
+  char buffer[512];
+  size_t bytes = 0;
+  int records = 0;
+  start = micros();
+  while (size_t length = journal.peek(buffer, sizeof(buffer))) {
+    journal.consume();
+    bytes += length;
+    records++;
+  }
+  unsigned long replayTime = micros() - start;
+
+  Serial.printf("record: %u bytes\r\n", (unsigned) sizeof(payload) - 1);
+  Serial.printf("append: %d records in %lu ms, %lu us per record\r\n", RECORDS, appendTime / 1000, appendTime / RECORDS);
+  Serial.printf("replay: %d records (%u bytes) in %lu ms, %lu us per record\r\n", records, (unsigned) bytes, replayTime / 1000, records ? replayTime / records : 0);
+}
+
+void loop() {}
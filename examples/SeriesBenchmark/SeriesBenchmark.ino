@@ -0,0 +1,56 @@
+// Compares an hour of temperature readings (one every 10 s) encoded as JSON arrays
+// and with IotLinkSeries, then decodes the series again and checks it.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "IotLinkSeries.h"
+
+#define READINGS 360
+
+IotLinkSample samples[READINGS];
+IotLinkSample decoded[READINGS];
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  IotLinkSeries series(samples, READINGS, 1);
+  DynamicJsonDocument doc(JSON_OBJECT_SIZE(2) + 2 * JSON_ARRAY_SIZE(READINGS));
+  JsonArray times = doc.createNestedArray("t");
+  JsonArray values = doc.createNestedArray("v");
+  for (int i = 0; i < READINGS; i++) {
+    uint32_t time = 1700000000UL + i * 10;
+    float value = roundf((21.5f + 2.0f * sinf(i / 60.0f) + (i % 7 == 0 ? 0.1f : 0.0f)) * 10) / 10;
+    series.add(i * 10000UL, value);
+    times.add(time);
+    values.add(value);
+  }
+  uint32_t now = READINGS * 10000UL;
+
+  static char base64[2048];
+  unsigned long start = micros();
+  size_t length = series.encodeBase64(base64, now);
+  unsigned long encodeTime = micros() - start;
+
+  static uint8_t raw[1536];
+  Base64Decoder decoder;
+  int rawLength = decoder.update(raw, base64, length);
+  rawLength += decoder.final(raw + rawLength);
+
+  uint8_t precision;
+  uint32_t age;
+  start = micros();
+  int count = IotLinkSeries::decode(raw, rawLength, decoded, READINGS, precision, age);
+  unsigned long decodeTime = micros() - start;
+
+  bool match = count == READINGS;
+  for (int i = 0; match && i < count; i++) {
+    match = decoded[i].time == samples[i].time && decoded[i].value == samples[i].value;
+  }
+
+  Serial.printf("JSON arrays: %u bytes\r\n", (unsigned) measureJson(doc));
+  Serial.printf("series: %d bytes, %u as Base64\r\n", rawLength, (unsigned) length);
+  Serial.printf("encode: %lu us, decode: %lu us, round trip %s\r\n", encodeTime, decodeTime, match ? "ok" : "FAILED");
+}
+
+void loop() {}
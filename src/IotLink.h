@@ -6,10 +6,21 @@
 #include "IotLinkWebsocket.h"
 #include "IotLinkSignature.h"
 #include "IotLinkMessageid.h"
+#include "IotLinkLeakyBucket.h"
+#if IOTLINK_OUTBOX_SIZE
+#include "IotLinkOutbox.h"
+#endif
+#if IOTLINK_JOURNAL
+#include "IotLinkJournal.h"
+#endif
+#if IOTLINK_ASYNC
+#include "IotLinkAsync.h"
+#endif
 
 
 class IotLinkClass : public IotLinkInterface {
   public:
+    IotLinkClass();
     void begin(String socketAuthToken, String signingKey, String serverURL = IOTLINK_SERVER_URL);
     template <typename DeviceType>
     DeviceType& add(const char* deviceId, unsigned long eventWaitTime = 1000);
@@ -28,9 +39,42 @@ class IotLinkClass : public IotLinkInterface {
 
     void restoreDeviceStates(bool flag);
 
-    DynamicJsonDocument prepareResponse(JsonDocument& requestMessage);
-    DynamicJsonDocument prepareEvent(const char* deviceId, const char* action, const char* cause) override;
-    void sendMessage(JsonDocument& jsonMessage) override;
+    // Events sent within window ms after the first one are collected into a single
+    // message with one signature, at most maxEvents events and maxBytes of payload
+    // (up to IOTLINK_BATCH_BUFFER_SIZE). Responses are never batched. window 0 turns
+    // batching off. The server has to accept "batch" payloads.
+    void setEventBatching(unsigned long window, size_t maxEvents = IOTLINK_BATCH_MAX_EVENTS, size_t maxBytes = IOTLINK_BATCH_BUFFER_SIZE);
+    // sends the collected events right away
+    void flushEvents();
+
+#if IOTLINK_OUTBOX_SIZE
+    // Messages sent while disconnected wait in the outbox and go out after reconnecting,
+    // in order within each lane (see Lane). overflow picks what is lost when it is full; restampCreatedAt sends
+    // them with the time they are actually sent instead of the time they were created.
+    void setOutboxPolicy(IotLinkOutbox::Overflow overflow, bool restampCreatedAt = false);
+#endif
+
+#if IOTLINK_JOURNAL
+    // Events sent while disconnected are written to a journal on flash instead of
+    // the outbox and replayed after reconnecting, paced by the event rate limit of
+    // their device. Until the journal is empty, new events are appended behind the
+    // older ones so they go out in order.
+    bool beginJournal(const char* directory = IOTLINK_JOURNAL_DIRECTORY);
+#endif
+
+#if IOTLINK_ASYNC
+    // Signing moves to a worker, sendEvent() and friends only render the payload
+    // and hand it over; handle() sends the signed messages. Call after begin().
+    bool beginAsync();
+    void endAsync();
+#endif
+
+    IotLinkMessage prepareResponse(JsonDocument& requestMessage);
+    IotLinkMessage prepareEvent(const char* deviceId, const char* action, const char* cause) override;
+    bool sendMessage(JsonDocument& jsonMessage) override;
+    bool sendEvent(const IotLinkEventTemplate& event, const char* cause, const char* value) override;
+    bool sendEvent(const IotLinkEventTemplate& event, const char* cause, JsonObject value) override;
+    bool sendEvent(const IotLinkEventTemplate& event, const char* cause, const IotLinkRecord& value) override;
 
     struct proxy {
       proxy(IotLinkClass* ptr, String deviceId) : ptr(ptr), deviceId(deviceId) {}
@@ -61,12 +105,52 @@ class IotLinkClass : public IotLinkInterface {
     bool verifyAppSecret(const char* secret);
     void extractTimestamp(JsonDocument &message);
 
+    // rendered event payloads go straight into txBuffer, behind the header
+    static const size_t payloadOffset = sizeof(IOTLINK_MESSAGE_HEADER) - 1;
+    static const size_t payloadSize = IOTLINK_TX_BUFFER_SIZE - payloadOffset - (sizeof(IOTLINK_MESSAGE_SIGNATURE) - 1) - SIGNATURE_LENGTH - (sizeof(IOTLINK_MESSAGE_TRAILER) - 1);
+    static const size_t frameSize = payloadOffset + (sizeof(IOTLINK_MESSAGE_SIGNATURE) - 1) + SIGNATURE_LENGTH + (sizeof(IOTLINK_MESSAGE_TRAILER) - 1);
+    // Outgoing traffic by urgency. Events with the cause PERIODIC_POLL are telemetry,
+    // all others report state changes. A payload waits in the outbox while
+    // disconnected or while its own or a more urgent lane holds queued payloads.
+    enum Lane : uint8_t { StateLane, TelemetryLane, LaneCount };
+    static Lane laneOf(const char* cause);
+
+    bool sendPayload(char* buffer, size_t length, Lane lane);
+    void transmitPayload(char* buffer, size_t length);
+    bool isQueueing(Lane lane);
+    bool isAsync();
+#if IOTLINK_OUTBOX_SIZE
+    void drainOutbox();
+    size_t restampPayload(char* payload, size_t length, size_t size);
+    static const size_t restampSlack = 10; // a createdAt can grow up to 10 digits
+    // longest payload in the outbox: an event or a batch
+    static const size_t queueLimit = payloadSize > IOTLINK_BATCH_BUFFER_SIZE ? payloadSize : IOTLINK_BATCH_BUFFER_SIZE;
+    // queued payloads are framed in txBuffer, restamped createdAt included
+    static const size_t txBufferSize = IOTLINK_TX_BUFFER_SIZE > queueLimit + restampSlack + frameSize ? IOTLINK_TX_BUFFER_SIZE : queueLimit + restampSlack + frameSize;
+#else
+    static const size_t txBufferSize = IOTLINK_TX_BUFFER_SIZE;
+#endif
+#if IOTLINK_JOURNAL
+    void replayJournal();
+    IotLinkDeviceInterface* deviceOf(const char* payload, size_t length);
+#endif
+#if IOTLINK_ASYNC
+    void sendSigned();
+    void drainSigner();
+#endif
+
+    // event payloads collected at batchBuffer + payloadOffset behind IOTLINK_BATCH_HEADER
+    template <typename Renderer>
+    bool batchEvent(Lane lane, Renderer render);
+    static const size_t batchTrailerSize = sizeof(IOTLINK_BATCH_TRAILER "4294967295}") - 1;
+
     IotLinkDeviceInterface* getDevice(String deviceId);
 
     template <typename DeviceType>
     DeviceType& getDeviceInstance(String deviceId);
 
     std::vector<IotLinkDeviceInterface*> devices;
+    IotLinkDeviceIndex deviceIndex;
     String socketAuthToken;
     String signingKey;
     String serverURL;
@@ -78,13 +162,58 @@ class IotLinkClass : public IotLinkInterface {
 
     bool _begin = false;
     String responseMessageStr = "";
+
+    MessageIDPool replyTokens;
+    IotLinkMessagePool messagePool;
+    char txBuffer[txBufferSize];
+
+    char* batchBuffer = nullptr;
+    size_t batchLength = 0;
+    size_t batchEvents = 0;
+    size_t batchMaxEvents = 0;
+    size_t batchMaxLength = 0;
+    unsigned long batchWindow = 0;
+    unsigned long batchStart = 0;
+    Lane batchLane = TelemetryLane;
+
+#if IOTLINK_OUTBOX_SIZE
+    // highest lane first; a lane passed over IOTLINK_LANE_AGING times goes next
+    int nextLane();
+    IotLinkOutbox outbox[LaneCount];
+    // state changes get a third, but at least room for the longest payload (batches
+    // of state changes go there too), telemetry the rest
+    static const size_t stateLaneSize = IOTLINK_OUTBOX_SIZE / 3 > queueLimit + 2 ? IOTLINK_OUTBOX_SIZE / 3 : queueLimit + 2;
+    static_assert(IOTLINK_OUTBOX_SIZE >= stateLaneSize + queueLimit + 2, "IOTLINK_OUTBOX_SIZE must hold the longest payload or batch in every lane");
+    uint8_t laneSkips[LaneCount] = {};
+    char outboxStorage[IOTLINK_OUTBOX_SIZE];
+    bool restampQueued = false;
+#endif
+#if IOTLINK_JOURNAL
+    IotLinkJournal journal;
+    IotLinkDeviceInterface* replayDevice = nullptr; // device of the oldest record
+    bool replayPeeked = false;
+    LeakyBucket replayBucket; // records of no known device
+    static_assert(payloadOffset >= IotLinkJournal::recordHeaderSize, "journal records are written in place of the message header");
+#endif
+#if IOTLINK_ASYNC
+    IotLinkAsyncSigner signer;
+#endif
 };
 
+static_assert(IOTLINK_TX_BUFFER_SIZE >= 256, "IOTLINK_TX_BUFFER_SIZE is too small");
+static_assert(IOTLINK_OUTBOX_SIZE < 65536, "IOTLINK_OUTBOX_SIZE must fit the two byte record length");
+
+IotLinkClass::IotLinkClass() {
+  _websocketListener.setMessagePool(&messagePool);
+#if IOTLINK_OUTBOX_SIZE
+  outbox[StateLane].begin(outboxStorage, stateLaneSize);
+  outbox[TelemetryLane].begin(outboxStorage + stateLaneSize, IOTLINK_OUTBOX_SIZE - stateLaneSize);
+  _websocketListener.onReady([this]() { drainOutbox(); });
+#endif
+}
+
 IotLinkDeviceInterface* IotLinkClass::getDevice(String deviceId) {
-  for (auto& device : devices) {
-    if (deviceId == String(device->getDeviceId())) return device;
-  }
-  return nullptr;
+  return deviceIndex.find(deviceId.c_str());
 }
 
 template <typename DeviceType>
@@ -125,11 +254,16 @@ void IotLinkClass::begin(String socketAuthToken, String signingKey, String serve
   this->signingKey = signingKey;
   this->serverURL = serverURL;
   _begin = true;
+#if IOTLINK_ASYNC
+  if (signer.isRunning()) beginAsync(); // the worker signs with its own copy of the key
+#endif
 }
 
 template <typename DeviceType>
 DeviceType& IotLinkClass::add(const char* deviceId, unsigned long eventWaitTime) {
   DeviceType* newDevice = new DeviceType(deviceId, eventWaitTime);
+  newDevice->fastPath = IotLinkFastPath<DeviceType>::value;
+  if (!verifyDeviceId(deviceId)) DEBUG_IOTLINK("[IotLink:add()]: DeviceId \"%s\" is not 24 lowercase hex characters, it is looked up as text\r\n", deviceId);
   //if (verifyDeviceId(deviceId)){
     DEBUG_IOTLINK("[IotLink:add()]: Adding device with id \"%s\".\r\n", deviceId);
     newDevice->begin(this);
@@ -139,6 +273,7 @@ DeviceType& IotLinkClass::add(const char* deviceId, unsigned long eventWaitTime)
 //    DEBUG_IOTLINK("[IotLink:add()]: DeviceId \"%s\" is invalid!! Device will be ignored and will NOT WORK!\r\n", deviceId);
 //  }
   devices.push_back(newDevice);
+  deviceIndex.add(newDevice);
   return *newDevice;
 }
 
@@ -147,6 +282,7 @@ void IotLinkClass::add(IotLinkDeviceInterface* newDevice) {
   //if (!verifyDeviceId(newDevice->getDeviceId())) return;
   newDevice->begin(this);
   devices.push_back(newDevice);
+  deviceIndex.add(newDevice);
 }
 
 __attribute__ ((deprecated("Please use DeviceType& myDevice = IotLink.add<DeviceType>(DeviceId);")))
@@ -154,6 +290,7 @@ void IotLinkClass::add(IotLinkDeviceInterface& newDevice) {
   //if (!verifyDeviceId(newDevice.getDeviceId())) return;
   newDevice.begin(this);
   devices.push_back(&newDevice);
+  deviceIndex.add(&newDevice);
 }
 
 void IotLinkClass::handle() {
@@ -171,6 +308,19 @@ void IotLinkClass::handle() {
 
   if (!isConnected()) connect();
   _websocketListener.handle();
+#if IOTLINK_ASYNC
+  sendSigned();
+#endif
+  for (auto& device : devices) device->handle();
+  if (batchEvents && millis() - batchStart >= batchWindow) flushEvents();
+#if IOTLINK_OUTBOX_SIZE
+  drainOutbox();
+#endif
+#if IOTLINK_JOURNAL
+  replayJournal();
+#endif
+
+  replyTokens.refill();
 }
 
 void IotLinkClass::connect() {
@@ -190,7 +340,7 @@ void IotLinkClass::connect() {
     return;
   }
 
-  _websocketListener.begin(serverURL, socketAuthToken, signingKey, devices, deviceList);
+  _websocketListener.begin(serverURL, socketAuthToken, signingKey, &deviceIndex, deviceList);
 }
 
 
@@ -221,10 +371,7 @@ void IotLinkClass::reconnect() {
 }
 
 bool IotLinkClass::verifyDeviceId(const char* id) {
-  if (strlen(id) != 24) return false;
-  int tmp; char tmp_c;
-  return sscanf(id, "%4x%4x%4x%4x%4x%4x%c", 
-         &tmp, &tmp, &tmp, &tmp, &tmp, &tmp, &tmp_c) == 6;
+  return DeviceId::isValid(id);
 }
 
 bool IotLinkClass::verifyAppKey(const char* key) {
@@ -262,19 +409,344 @@ void IotLinkClass::extractTimestamp(JsonDocument &message) {
 }
 
 
-void IotLinkClass::sendMessage(JsonDocument& jsonMessage) {
+// false if the message was dropped
+bool IotLinkClass::sendMessage(JsonDocument& jsonMessage) {
 
     jsonMessage["payload"]["createdAt"] = getTimestamp();
-    signMessage(signingKey, jsonMessage);
+    bool binary = _websocketListener.isBinary();
+
+    if (batchWindow && !binary && jsonMessage["payload"]["type"] == "event") {
+      JsonVariant payload = jsonMessage["payload"];
+      if (batchEvent(laneOf(payload["cause"]["type"] | ""), [&](char* buffer, size_t size) -> size_t {
+        return measureJson(payload) < size ? serializeJson(payload, buffer, size) : 0;
+      })) return true;
+    }
+
+#if IOTLINK_OUTBOX_SIZE || IOTLINK_JOURNAL || IOTLINK_ASYNC
+    // queued or handed to the signing worker as payload text, signed when it is sent;
+    // longer ones are sent right away below
+    JsonVariant payload = jsonMessage["payload"];
+    Lane lane = laneOf(payload["cause"]["type"] | "");
+    if ((isQueueing(lane) || (isAsync() && !binary)) && measureJson(payload) < payloadSize) {
+      return sendPayload(txBuffer, serializeJson(payload, txBuffer + payloadOffset, payloadSize), lane);
+    }
+#endif
 
-    String messageString;
+    if (!isConnected()) {
+      DEBUG_IOTLINK("[IotLink:sendMessage()]: not connected, message dropped\r\n");
+      return false;
+    }
+    signMessage(signingKey, jsonMessage, binary);
+#if IOTLINK_ASYNC
+    drainSigner();
+#endif
 
-    serializeJson(jsonMessage, messageString);
+    if (binary) {
+      size_t length = measureMsgPack(jsonMessage);
+      if (length > sizeof(txBuffer)) {
+        DEBUG_IOTLINK("[IotLink:sendMessage()]: MessagePack message of %u bytes exceeds the transmit buffer, dropped\r\n", (unsigned) length);
+        return false;
+      }
+      serializeMsgPack(jsonMessage, txBuffer, length);
+      _websocketListener.sendBinary((const uint8_t*) txBuffer, length);
+      return true;
+    }
 
-    if(isConnected()) {
+    if (measureJson(jsonMessage) < sizeof(txBuffer)) {
+      size_t length = serializeJson(jsonMessage, txBuffer, sizeof(txBuffer));
+      _websocketListener.sendMessage(txBuffer, length);
+    } else {
+      String messageString;
+      serializeJson(jsonMessage, messageString);
       _websocketListener.sendMessage(messageString);
     }
+    return true;
+}
+
+
+// templates render JSON text, in MessagePack mode events take the JsonDocument way
+bool IotLinkClass::sendEvent(const IotLinkEventTemplate& event, const char* cause, const char* value) {
+  if (_websocketListener.isBinary()) return false;
+  Lane lane = laneOf(cause);
+  if (batchWindow && batchEvent(lane, [&](char* buffer, size_t size) {
+    return event.render(buffer, size, cause, getTimestamp(), replyTokens.next(), value);
+  })) return true;
+
+  size_t length = event.render(txBuffer + payloadOffset, payloadSize, cause, getTimestamp(), replyTokens.next(), value);
+  if (!length) return false;
+  return sendPayload(txBuffer, length, lane);
+}
+
+bool IotLinkClass::sendEvent(const IotLinkEventTemplate& event, const char* cause, JsonObject value) {
+  if (_websocketListener.isBinary()) return false;
+  Lane lane = laneOf(cause);
+  if (batchWindow && batchEvent(lane, [&](char* buffer, size_t size) {
+    return event.render(buffer, size, cause, getTimestamp(), replyTokens.next(), value);
+  })) return true;
+
+  size_t length = event.render(txBuffer + payloadOffset, payloadSize, cause, getTimestamp(), replyTokens.next(), value);
+  if (!length) return false;
+  return sendPayload(txBuffer, length, lane);
+}
+
+bool IotLinkClass::sendEvent(const IotLinkEventTemplate& event, const char* cause, const IotLinkRecord& value) {
+  if (_websocketListener.isBinary()) return false;
+  Lane lane = laneOf(cause);
+  if (batchWindow && batchEvent(lane, [&](char* buffer, size_t size) {
+    return event.renderValue(buffer, size, cause, getTimestamp(), replyTokens.next(), value);
+  })) return true;
+
+  size_t length = event.renderValue(txBuffer + payloadOffset, payloadSize, cause, getTimestamp(), replyTokens.next(), value);
+  if (!length) return false;
+  return sendPayload(txBuffer, length, lane);
+}
+
+// sends the payload rendered at buffer + payloadOffset, or queues it in its lane;
+// false if it was dropped
+bool IotLinkClass::sendPayload(char* buffer, size_t length, Lane lane) {
+#if IOTLINK_JOURNAL
+  if ((!isConnected() || !journal.empty()) && length <= payloadSize &&
+      journal.append(buffer + payloadOffset - IotLinkJournal::recordHeaderSize, length)) return true;
+#endif
+#if IOTLINK_OUTBOX_SIZE
+  if (isQueueing(lane)) {
+    bool queued = outbox[lane].push(buffer + payloadOffset, length);
+    drainOutbox();
+    return queued;
+  }
+#else
+  if (!isConnected()) return false;
+#endif
+  transmitPayload(buffer, length);
+  return true;
+}
+
+// true if a payload of lane has to wait in the outbox
+bool IotLinkClass::isQueueing(Lane lane) {
+  if (!isConnected()) return true;
+#if IOTLINK_OUTBOX_SIZE
+  for (int i = 0; i <= lane; i++) {
+    if (!outbox[i].empty()) return true;
+  }
+#endif
+  return false;
+}
+
+IotLinkClass::Lane IotLinkClass::laneOf(const char* cause) {
+  return strcmp(cause, "PERIODIC_POLL") == 0 ? TelemetryLane : StateLane;
+}
+
+bool IotLinkClass::isAsync() {
+#if IOTLINK_ASYNC
+  return signer.isRunning();
+#else
+  return false;
+#endif
+}
+
+// frames the payload at buffer + payloadOffset with header and signature
+void IotLinkClass::transmitPayload(char* buffer, size_t length) {
+#if IOTLINK_ASYNC
+  if (signer.isRunning() && length <= payloadSize) {
+    char* slot;
+    while (!(slot = signer.acquire())) {
+      sendSigned();
+      signer.wait();
+    }
+    memcpy(slot + payloadOffset, buffer + payloadOffset, length);
+    signer.submit(length);
+    return;
+  }
+  drainSigner();
+#endif
+  length = frameMessage(signingKey.c_str(), buffer, length);
+  if (isConnected()) _websocketListener.sendMessage(buffer, length);
+}
+
+#if IOTLINK_OUTBOX_SIZE
+void IotLinkClass::setOutboxPolicy(IotLinkOutbox::Overflow overflow, bool restampCreatedAt) {
+  for (auto& lane : outbox) lane.setOverflow(overflow);
+  restampQueued = restampCreatedAt;
+}
+
+int IotLinkClass::nextLane() {
+  int next = -1;
+  for (int lane = 0; lane < LaneCount; lane++) {
+    if (outbox[lane].empty()) continue;
+    if (next < 0) { next = lane; continue; }
+    if (++laneSkips[lane] >= IOTLINK_LANE_AGING) { laneSkips[lane] = 0; return lane; }
+  }
+  if (next >= 0) laneSkips[next] = 0;
+  return next;
+}
+
+// sends up to IOTLINK_OUTBOX_DRAIN_COUNT queued payloads, by lane and oldest first
+void IotLinkClass::drainOutbox() {
+  for (auto& lane : outbox) {
+    if (size_t dropped = lane.takeDropped()) DEBUG_IOTLINK("[IotLink]: outbox full, %u messages dropped\r\n", (unsigned) dropped);
+  }
+
+  for (int i = 0; i < IOTLINK_OUTBOX_DRAIN_COUNT && isConnected(); i++) {
+    int lane = nextLane();
+    if (lane < 0) return;
+    size_t length = outbox[lane].front();
+    outbox[lane].shift(txBuffer + payloadOffset);
+    if (restampQueued) length = restampPayload(txBuffer + payloadOffset, length, length + restampSlack);
+    transmitPayload(txBuffer, length);
+  }
+}
+
+// replaces the top level createdAt of a queued payload with the current time
+size_t IotLinkClass::restampPayload(char* payload, size_t length, size_t size) {
+  IotLinkJsonReader reader(payload, length);
+  IotLinkStringView createdAt;
+  if (!reader.beginObject() || !reader.findMember("createdAt", createdAt)) return length;
+
+  char number[restampSlack];
+  IotLinkTextWriter out(number, sizeof(number));
+  out.putNumber(getTimestamp());
+  size_t numberLength = out.length();
+  if (!numberLength || length - createdAt.length + numberLength > size) return length;
+
+  char* start = payload + (createdAt.data - payload);
+  size_t rest = length - (start - payload) - createdAt.length;
+  memmove(start + numberLength, start + createdAt.length, rest);
+  memcpy(start, number, numberLength);
+  return length - createdAt.length + numberLength;
+}
+#endif
+
+#if IOTLINK_JOURNAL
+bool IotLinkClass::beginJournal(const char* directory) {
+  if (journal.begin(directory)) return true;
+  DEBUG_IOTLINK("[IotLink:beginJournal()]: journal in \"%s\" not available\r\n", directory);
+  return false;
+}
+
+// sends the oldest journaled event once no state change is queued, taking a drop from
+// the leaky bucket of its device so replayed and live events share one rate limit
+void IotLinkClass::replayJournal() {
+  if (journal.empty() || isQueueing(StateLane)) return;
+  size_t length = 0;
+  if (!replayPeeked) {
+    length = journal.peek(txBuffer + payloadOffset, payloadSize);
+    if (!length) return;
+    replayDevice = deviceOf(txBuffer + payloadOffset, length);
+    replayPeeked = true;
+  }
+  if (!(replayDevice ? replayDevice->admitReplay() : replayBucket.addDrop(false))) return;
+
+  if (!length) length = journal.peek(txBuffer + payloadOffset, payloadSize); // txBuffer was used since
+  replayPeeked = false;
+  if (!length) return;
+  journal.consume();
+  transmitPayload(txBuffer, length);
+}
+
+// device a journaled payload belongs to, for a batch the device of its first event
+IotLinkDeviceInterface* IotLinkClass::deviceOf(const char* payload, size_t length) {
+  IotLinkJsonReader reader(payload, length);
+  IotLinkStringView key, raw, deviceId;
+  if (!reader.beginObject()) return nullptr;
+  while (reader.nextMember(key) && reader.skipValue(&raw)) {
+    if (key.equals("events") && raw.length > 1) return deviceOf(raw.data + 1, raw.length - 1);
+    if (!key.equals("deviceId")) continue;
+    char id[64];
+    if (!IotLinkJsonReader(raw.data, raw.length).readString(deviceId) || deviceId.length >= sizeof(id)) return nullptr;
+    memcpy(id, deviceId.data, deviceId.length);
+    id[deviceId.length] = '\0';
+    return deviceIndex.find(id);
+  }
+  return nullptr;
+}
+#endif
+
+#if IOTLINK_ASYNC
+bool IotLinkClass::beginAsync() {
+  if (signer.begin(signingKey.c_str())) return true;
+  DEBUG_IOTLINK("[IotLink:beginAsync()]: worker not started, messages are signed in the loop\r\n");
+  return false;
+}
+
+void IotLinkClass::endAsync() {
+  signer.end();
+  sendSigned();
+}
+
+// sends what the worker has signed, in the order it was handed over
+void IotLinkClass::sendSigned() {
+  size_t length;
+  while (const char* message = signer.ready(length)) {
+    if (isConnected()) _websocketListener.sendMessage(message, length);
+    signer.release();
+  }
+}
+
+// sends everything handed to the worker, before a message that does not go through it
+void IotLinkClass::drainSigner() {
+  while (!signer.empty()) {
+    sendSigned();
+    if (!signer.empty()) signer.wait();
+  }
+}
+#endif
+
+void IotLinkClass::setEventBatching(unsigned long window, size_t maxEvents, size_t maxBytes) {
+  flushEvents();
+  free(batchBuffer);
+  batchBuffer = nullptr;
+  batchWindow = 0;
+  if (!window || !maxEvents) return;
+
+  if (maxBytes > IOTLINK_BATCH_BUFFER_SIZE) maxBytes = IOTLINK_BATCH_BUFFER_SIZE;
+  if (maxBytes < 256) maxBytes = 256;
+  batchBuffer = (char*) malloc(maxBytes + frameSize);
+  if (!batchBuffer) {
+    DEBUG_IOTLINK("[IotLink:setEventBatching()]: out of memory, events are not batched\r\n");
+    return;
+  }
+  batchWindow = window;
+  batchMaxEvents = maxEvents;
+  batchMaxLength = maxBytes;
+}
+
+// Appends an event payload to the batch. render writes it into (buffer, size) and
+// returns its length, 0 if it does not fit. A full batch is sent first; false if
+// the event does not fit into an empty batch either.
+template <typename Renderer>
+bool IotLinkClass::batchEvent(Lane lane, Renderer render) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    const char* separator = batchEvents ? "," : IOTLINK_BATCH_HEADER;
+    size_t separatorLength = strlen(separator);
+    size_t space = batchMaxLength - batchTrailerSize - batchLength;
+    char* p = batchBuffer + payloadOffset + batchLength;
+
+    size_t length = space > separatorLength ? render(p + separatorLength, space - separatorLength) : 0;
+    if (length) {
+      memcpy(p, separator, separatorLength);
+      if (!batchEvents) batchStart = millis();
+      if (!batchEvents || lane < batchLane) batchLane = lane;
+      batchLength += separatorLength + length;
+      if (++batchEvents >= batchMaxEvents) flushEvents();
+      return true;
+    }
+    if (!batchEvents) return false;
+    flushEvents();
+  }
+  return false;
+}
 
+void IotLinkClass::flushEvents() {
+  if (!batchEvents) return;
+  IotLinkTextWriter out(batchBuffer + payloadOffset + batchLength, batchTrailerSize);
+  out.put(IOTLINK_BATCH_TRAILER);
+  out.putNumber(getTimestamp());
+  out.put("}");
+  size_t length = batchLength + out.length();
+  DEBUG_IOTLINK("[IotLink:flushEvents()]: sending %u events in one message\r\n", (unsigned) batchEvents);
+  batchLength = 0;
+  batchEvents = 0;
+  sendPayload(batchBuffer, length, batchLane);
 }
 
 
@@ -282,13 +754,13 @@ void IotLinkClass::restoreDeviceStates(bool flag) {
   _websocketListener.setRestoreDeviceStates(flag);
 }
 
-DynamicJsonDocument IotLinkClass::prepareResponse(JsonDocument& requestMessage) {
-  DynamicJsonDocument responseMessage(1024);
-  JsonObject header = responseMessage.createNestedObject("header");
+IotLinkMessage IotLinkClass::prepareResponse(JsonDocument& requestMessage) {
+  IotLinkMessage responseMessage = messagePool.borrow();
+  JsonObject header = responseMessage->createNestedObject("header");
   header["payloadVersion"] = 2;
   header["signatureVersion"] = 1;
 
-  JsonObject payload = responseMessage.createNestedObject("payload");
+  JsonObject payload = responseMessage->createNestedObject("payload");
   payload["action"] = requestMessage["payload"]["action"];
   payload["clientId"] = requestMessage["payload"]["clientId"];
   payload["createdAt"] = 0;
@@ -302,19 +774,19 @@ DynamicJsonDocument IotLinkClass::prepareResponse(JsonDocument& requestMessage)
 }
 
 
-DynamicJsonDocument IotLinkClass::prepareEvent(const char* deviceId, const char* action, const char* cause) {
-  DynamicJsonDocument eventMessage(1024);
-  JsonObject header = eventMessage.createNestedObject("header");
+IotLinkMessage IotLinkClass::prepareEvent(const char* deviceId, const char* action, const char* cause) {
+  IotLinkMessage eventMessage = messagePool.borrow();
+  JsonObject header = eventMessage->createNestedObject("header");
   header["payloadVersion"] = 2;
   header["signatureVersion"] = 1;
 
-  JsonObject payload = eventMessage.createNestedObject("payload");
+  JsonObject payload = eventMessage->createNestedObject("payload");
   payload["action"] = action;
   payload["cause"].createNestedObject("type");
   payload["cause"]["type"] = cause;
   payload["createdAt"] = 0;
   payload["deviceId"] = deviceId;
-  payload["replyToken"] = MessageID().getID();
+  payload["replyToken"] = (char*) replyTokens.next(); // char* is copied, the pool slot gets reused
   payload["type"] = "event";
   payload.createNestedObject("value");
   return eventMessage;
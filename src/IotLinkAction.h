@@ -0,0 +1,77 @@
+#ifndef _IOTLINKACTION_H_
+#define _IOTLINKACTION_H_
+
+#include <ArduinoJson.h>
+#include "IotLinkRequest.h"
+#include "IotLinkMessageTemplate.h"
+
+// FNV-1a hash of an action name, evaluated at compile time for literals
+constexpr uint32_t actionHash(const char* name, uint32_t hash = 2166136261u) {
+  return *name ? actionHash(name + 1, (hash ^ (uint8_t) *name) * 16777619u) : hash;
+}
+
+// same hash over an action name inside a received message
+inline uint32_t actionHash(const IotLinkStringView& name) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < name.length; i++) hash = (hash ^ (uint8_t) name.data[i]) * 16777619u;
+  return hash;
+}
+
+// Entry of a device's static request dispatch table. The hash is computed by the
+// compiler, so resolving an incoming action costs one hash over the received name,
+// integer compares over the table and a single string compare on the match.
+//
+//   const IotLinkAction<MyDevice> MyDevice::actions[] = {
+//     IOTLINK_ACTION("setBrightness", &MyDevice::handleBrightness),
+//   };
+//
+// An action can also get a fast handler working on the received text (see
+// IotLinkFastRequest) which writes the members of the response value; requests
+// for actions without one take the JsonDocument path.
+template <typename DeviceType>
+struct IotLinkAction {
+  typedef bool (DeviceType::*Handler)(JsonObject &request_value, JsonObject &response_value);
+  typedef bool (DeviceType::*FastHandler)(const IotLinkFastRequest &request, IotLinkTextWriter &response_value);
+  uint32_t hash;
+  const char* name;
+  Handler handler;
+  FastHandler fastHandler;
+};
+
+#define IOTLINK_ACTION(name, handler) { actionHash(name), name, handler, nullptr }
+#define IOTLINK_FAST_ACTION(name, handler, fastHandler) { actionHash(name), name, handler, fastHandler }
+
+template <typename DeviceType, size_t N>
+const IotLinkAction<DeviceType>* findAction(const IotLinkAction<DeviceType> (&actions)[N], const IotLinkStringView& action) {
+  const uint32_t hash = actionHash(action);
+  for (size_t i = 0; i < N; i++) {
+    if (actions[i].hash == hash && action.equals(actions[i].name)) return &actions[i];
+  }
+  return nullptr;
+}
+
+template <typename DeviceType, size_t N>
+const IotLinkAction<DeviceType>* findAction(const IotLinkAction<DeviceType> (&actions)[N], const char* action) {
+  if (!action) return nullptr; // request without an action
+  return findAction(actions, IotLinkStringView(action, strlen(action)));
+}
+
+// calls the handler registered for action, returns false if there is none
+template <typename DeviceType, size_t N>
+bool dispatchAction(DeviceType* device, const IotLinkAction<DeviceType> (&actions)[N], const char* action, JsonObject &request_value, JsonObject &response_value, bool &success) {
+  const IotLinkAction<DeviceType>* entry = findAction(actions, action);
+  if (!entry) return false;
+  success = (device->*(entry->handler))(request_value, response_value);
+  return true;
+}
+
+// calls the fast handler registered for the request's action, returns false if there is none
+template <typename DeviceType, size_t N>
+bool dispatchFastAction(DeviceType* device, const IotLinkAction<DeviceType> (&actions)[N], const IotLinkFastRequest &request, IotLinkTextWriter &response_value, bool &success) {
+  const IotLinkAction<DeviceType>* entry = findAction(actions, request.action);
+  if (!entry || !entry->fastHandler) return false;
+  success = (device->*(entry->fastHandler))(request, response_value);
+  return true;
+}
+
+#endif
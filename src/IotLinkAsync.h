@@ -0,0 +1,188 @@
+#ifndef _IOTLINKASYNC_H_
+#define _IOTLINKASYNC_H_
+
+#include <atomic>
+#include "IotLinkConfig.h"
+#include "IotLinkSignature.h"
+
+#if defined(ESP8266)
+#error "IOTLINK_ASYNC needs a second thread, which the ESP8266 does not have"
+#elif defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+// Signs outgoing messages on a worker: a FreeRTOS task on the other core of the
+// ESP32, a thread elsewhere. Payloads are handed over in a ring of fixed
+// message buffers and come back framed and signed in the order submitted. The
+// socket is only used from the loop, WebSocketsClient is not thread safe.
+class IotLinkAsyncSigner {
+  public:
+    IotLinkAsyncSigner() : head(0), tail(0), next(0), running(false) {
+      for (auto& slot : slots) slot.state = Free;
+    }
+    ~IotLinkAsyncSigner() { end(); }
+
+    // key is copied, the worker signs with it until end()
+    bool begin(const char* key);
+    void end();
+    bool isRunning() const { return running; }
+
+    // buffer for the next message, its payload goes behind IOTLINK_MESSAGE_HEADER;
+    // nullptr while all buffers are in use
+    char* acquire();
+    // hands the acquired buffer with a payload of length bytes to the worker
+    void submit(size_t length);
+    // oldest message once it is signed, nullptr if there is none (yet)
+    const char* ready(size_t& length);
+    // done with the message returned by ready()
+    void release();
+    // give the worker time while waiting for a buffer
+    void wait();
+    // true once every submitted message has been released
+    bool empty() const { return head == tail; }
+
+  private:
+    enum : uint8_t { Free, Queued, Signed };
+    struct slot {
+      char buffer[IOTLINK_TX_BUFFER_SIZE];
+      size_t length;
+      std::atomic<uint8_t> state;
+    };
+
+    bool signNext(); // worker side, false if there is nothing to sign
+    void work();
+
+    slot slots[IOTLINK_ASYNC_SLOTS];
+    String key;
+    size_t head;  // oldest message not released, loop side
+    size_t tail;  // next buffer to acquire, loop side
+    size_t next;  // next message to sign, worker side
+    std::atomic<bool> running;
+
+#if defined(ESP32)
+    static void taskMain(void* signer);
+    TaskHandle_t task = nullptr;
+    std::atomic<bool> stopped;
+#else
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wakeup;
+#endif
+};
+
+bool IotLinkAsyncSigner::begin(const char* key) {
+  end();
+  this->key = key;
+  running = true;
+#if defined(ESP32)
+  stopped = false;
+  if (xTaskCreatePinnedToCore(taskMain, "iotlink-sign", 4096, this, 1, &task, IOTLINK_ASYNC_CORE) != pdPASS) {
+    running = false;
+    return false;
+  }
+#else
+  thread = std::thread([this]() { work(); });
+#endif
+  return true;
+}
+
+void IotLinkAsyncSigner::end() {
+  if (!running) return;
+  running = false;
+#if defined(ESP32)
+  xTaskNotifyGive(task);
+  while (!stopped) vTaskDelay(1);
+  task = nullptr;
+#else
+  { std::lock_guard<std::mutex> guard(lock); }
+  wakeup.notify_one();
+  thread.join();
+#endif
+  // whatever the worker left behind is signed here
+  while (signNext()) {}
+}
+
+char* IotLinkAsyncSigner::acquire() {
+  if (tail - head == IOTLINK_ASYNC_SLOTS) return nullptr;
+  return slots[tail % IOTLINK_ASYNC_SLOTS].buffer;
+}
+
+void IotLinkAsyncSigner::submit(size_t length) {
+  slot& s = slots[tail % IOTLINK_ASYNC_SLOTS];
+  s.length = length;
+  tail++;
+#if defined(ESP32)
+  s.state.store(Queued, std::memory_order_release);
+  xTaskNotifyGive(task);
+#else
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    s.state.store(Queued, std::memory_order_release);
+  }
+  wakeup.notify_one();
+#endif
+}
+
+const char* IotLinkAsyncSigner::ready(size_t& length) {
+  if (head == tail) return nullptr;
+  slot& s = slots[head % IOTLINK_ASYNC_SLOTS];
+  if (s.state.load(std::memory_order_acquire) != Signed) return nullptr;
+  length = s.length;
+  return s.buffer;
+}
+
+void IotLinkAsyncSigner::release() {
+  slots[head % IOTLINK_ASYNC_SLOTS].state.store(Free, std::memory_order_release);
+  head++;
+}
+
+void IotLinkAsyncSigner::wait() {
+#if defined(ESP32)
+  vTaskDelay(1);
+#else
+  std::this_thread::yield();
+#endif
+}
+
+bool IotLinkAsyncSigner::signNext() {
+  slot& s = slots[next % IOTLINK_ASYNC_SLOTS];
+  if (s.state.load(std::memory_order_acquire) != Queued) return false;
+  s.length = frameMessage(key.c_str(), s.buffer, s.length);
+  s.state.store(Signed, std::memory_order_release);
+  next++;
+  return true;
+}
+
+#if defined(ESP32)
+void IotLinkAsyncSigner::taskMain(void* signer) {
+  ((IotLinkAsyncSigner*) signer)->work();
+  vTaskDelete(nullptr);
+}
+
+void IotLinkAsyncSigner::work() {
+  while (running) {
+    while (running && signNext()) {}
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+  stopped = true;
+}
+#else
+void IotLinkAsyncSigner::work() {
+  std::unique_lock<std::mutex> guard(lock);
+  while (running) {
+    guard.unlock();
+    while (running && signNext()) {}
+    guard.lock();
+    wakeup.wait(guard, [this]() {
+      return !running || slots[next % IOTLINK_ASYNC_SLOTS].state.load(std::memory_order_acquire) == Queued;
+    });
+  }
+}
+#endif
+
+#endif
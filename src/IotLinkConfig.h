@@ -21,9 +21,119 @@
 #define WEBSOCKET_PING_TIMEOUT 10000
 #define WEBSOCKET_RETRY_COUNT 2
 
+// Message Configuration
+#ifndef IOTLINK_MESSAGE_POOL_SIZE
+#define IOTLINK_MESSAGE_POOL_SIZE 4     // preallocated documents, max 32
+#endif
+#ifndef IOTLINK_MESSAGE_CAPACITY
+#define IOTLINK_MESSAGE_CAPACITY 1024   // capacity of each pooled document
+#endif
+#ifndef IOTLINK_TX_BUFFER_SIZE
+#define IOTLINK_TX_BUFFER_SIZE 1024     // serialized outgoing message
+#endif
+#ifndef IOTLINK_RESPONSE_VALUE_SIZE
+#define IOTLINK_RESPONSE_VALUE_SIZE 128  // response value written by a fast action handler
+#endif
+#ifndef IOTLINK_INBOUND_MAX_LENGTH
+#define IOTLINK_INBOUND_MAX_LENGTH 4096 // longer incoming messages are rejected unparsed
+#endif
+#ifndef IOTLINK_INBOUND_MAX_CAPACITY
+#define IOTLINK_INBOUND_MAX_CAPACITY 4096 // largest document for an incoming message that outgrows the pool
+#endif
+
+// Outbox Configuration
+#ifndef IOTLINK_OUTBOX_SIZE
+#define IOTLINK_OUTBOX_SIZE 3072        // bytes of payloads kept while disconnected, 0 = drop them
+#endif
+#ifndef IOTLINK_OUTBOX_DRAIN_COUNT
+#define IOTLINK_OUTBOX_DRAIN_COUNT 4    // queued messages sent per handle() call
+#endif
+#ifndef IOTLINK_LANE_AGING
+#define IOTLINK_LANE_AGING 8            // a lane passed over this often by more urgent ones is served next
+#endif
+
+// Offline Journal Configuration, see IotLink.beginJournal()
+#ifndef IOTLINK_JOURNAL
+#define IOTLINK_JOURNAL 0               // 1 = keep events sent while disconnected on LittleFS (a plain file off the ESP)
+#endif
+#ifndef IOTLINK_JOURNAL_DIRECTORY
+#define IOTLINK_JOURNAL_DIRECTORY "/iotlink"
+#endif
+#ifndef IOTLINK_JOURNAL_SEGMENT_SIZE
+#define IOTLINK_JOURNAL_SEGMENT_SIZE 4096 // bytes per segment file
+#endif
+#ifndef IOTLINK_JOURNAL_SEGMENTS
+#define IOTLINK_JOURNAL_SEGMENTS 16     // the oldest segment is dropped when another one is needed
+#endif
+
+// Async Signing Configuration, see IotLink.beginAsync()
+#ifndef IOTLINK_ASYNC
+#define IOTLINK_ASYNC 0                 // 1 = sign outgoing messages on a worker (ESP32 task, a thread off the ESP; not on ESP8266)
+#endif
+#ifndef IOTLINK_ASYNC_SLOTS
+#define IOTLINK_ASYNC_SLOTS 4           // messages of IOTLINK_TX_BUFFER_SIZE bytes handed to the worker
+#endif
+#ifndef IOTLINK_ASYNC_CORE
+#define IOTLINK_ASYNC_CORE 0            // ESP32 core of the worker, the Arduino loop runs on core 1
+#endif
+
+// Sensor Event Configuration
+#ifndef IOTLINK_DEADBAND_RULES
+#define IOTLINK_DEADBAND_RULES 4        // IotLinkControl::setDeadband() rules per device
+#endif
+#ifndef IOTLINK_AGGREGATIONS
+#define IOTLINK_AGGREGATIONS 2          // IotLinkControl::setAggregation() actions per device
+#endif
+#ifndef IOTLINK_AGGREGATE_FIELDS
+#define IOTLINK_AGGREGATE_FIELDS 4      // aggregated fields per device, over all actions
+#endif
+#ifndef IOTLINK_FIELD_NAME_SIZE
+#define IOTLINK_FIELD_NAME_SIZE 24      // longest IOTLINK_FIELD() member name + 1
+#endif
+
+// Event Batching Configuration, see IotLink.setEventBatching()
+#ifndef IOTLINK_BATCH_BUFFER_SIZE
+#define IOTLINK_BATCH_BUFFER_SIZE 1024  // default and largest payload of a batch message, also sizes the transmit buffer with an outbox
+#endif
+#ifndef IOTLINK_BATCH_MAX_EVENTS
+#define IOTLINK_BATCH_MAX_EVENTS 16     // default number of events per batch message
+#endif
+
+// Wire Encoding Configuration
+#ifndef IOTLINK_MSGPACK
+#define IOTLINK_MSGPACK 0 // 1 = offer MessagePack frames to the server ("encoding:msgpack" header), up to IOTLINK_TX_BUFFER_SIZE bytes
+#endif
+
+#ifndef IOTLINK_DEFLATE
+#define IOTLINK_DEFLATE 0 // 1 = offer deflate with the preset dictionary ("compression:deflate-iotlink1" header)
+#endif
+#define IOTLINK_DEFLATE_NAME "deflate-iotlink1" // names the dictionary in IotLinkDeflate.h, bump it when that changes
+#define IOTLINK_DEFLATE_MARKER 0xc1         // first byte of a compressed binary frame, never valid MessagePack
+#ifndef IOTLINK_DEFLATE_MIN_LENGTH
+#define IOTLINK_DEFLATE_MIN_LENGTH 64       // shorter messages are sent as they are
+#endif
+#ifndef IOTLINK_DEFLATE_MAX_LENGTH
+#define IOTLINK_DEFLATE_MAX_LENGTH 2048     // longer messages are sent as they are, sizes the compression buffer
+#endif
+
 // LeakyBucket Configuration
 #define BUCKET_SIZE 10
 #define DROP_OUT_TIME 60000
 #define DROP_IN_TIME 1000u
+#ifndef IOTLINK_EVENT_SLOTS
+#define IOTLINK_EVENT_SLOTS 3 // actions per device with their own eventWaitTime and held event
+#endif
+#ifndef IOTLINK_HELD_EVENTS
+#define IOTLINK_HELD_EVENTS 4         // events held back at the same time, all devices together
+#endif
+#ifndef IOTLINK_EVENT_ACTION_SIZE
+#define IOTLINK_EVENT_ACTION_SIZE 32  // longest action name with an event slot + 1
+#endif
+#ifndef IOTLINK_EVENT_CAUSE_SIZE
+#define IOTLINK_EVENT_CAUSE_SIZE 24   // longest cause of a held event + 1
+#endif
+#ifndef IOTLINK_EVENT_VALUE_SIZE
+#define IOTLINK_EVENT_VALUE_SIZE 256  // longest value of a held event + 1, longer ones are dropped
+#endif
 
 #endif
@@ -2,6 +2,7 @@
 #define _IOTLINKCONTROL_H_
 
 #include "IotLinkDevice.h"
+#include "IotLinkSeries.h"
 
 class IotLinkControl :  public IotLinkDevice {
   public:
@@ -9,24 +10,319 @@ class IotLinkControl :  public IotLinkDevice {
 
     // event
     bool sendSensorEvent(JsonObject value, const char* action, String cause = "PERIODIC_POLL");
+    // typed values, a struct with an IOTLINK_SCHEMA (see IotLinkSchema.h), written
+    // straight into the event without a JsonDocument
+    template <typename T>
+    bool sendSensorValues(const T& value, const char* action, String cause = "PERIODIC_POLL") { return sendSensorEvent(IotLinkRecord::of(value), action, cause); }
+    bool sendSensorEvent(const IotLinkRecord& value, const char* action, String cause = "PERIODIC_POLL");
+    // sends all readings of series at once as {"<field>":{"series":"<Base64 of the encoding>"}},
+    // see IotLinkSeries for the encoding. A series is never held back, false if it was
+    // not sent (rate limited, dropped): keep the series and call again later
+    bool sendSensorSeries(const char* action, const char* field, const IotLinkSeries& series, String cause = "PERIODIC_POLL");
+
+    // Change suppression for a numeric field of an action's sensor events. A reading is
+    // only sent if a field with a rule moved more than absolute or more than relative
+    // times its last sent value (any change if both are 0), or if heartbeat ms (0 = never)
+    // have passed since the last sent reading. Actions without rules are always sent.
+    bool setDeadband(const char* action, const char* field, float absolute, float relative = 0, unsigned long heartbeat = 0);
+    // true if a reading with this value would be sent, to check before building the JsonObject
+    bool hasChanged(const char* action, const char* field, float value);
+
+    // Edge aggregation: readings passed to addReading() are folded per field into
+    // min, max, mean, last and count. When window ms (0 = no limit) have passed since
+    // the first one, or maxCount readings were added (0 = no limit), they are sent as
+    // one sensor event:
+    //   {"temperature":{"min":..,"max":..,"mean":..,"last":..,"count":..},...}
+    // The event is rate limited like any other (see eventWaitTime). While the last
+    // summary is still held back, or when a summary could neither be sent nor held
+    // (no free event slot or held buffer, value longer than IOTLINK_EVENT_VALUE_SIZE,
+    // link down), the window stays open and keeps collecting readings until a later
+    // flush gets its summary out. A window shorter than eventWaitTime therefore makes
+    // the summaries cover more time. A summary longer than IOTLINK_EVENT_VALUE_SIZE
+    // can not be held and only goes out while the action is not rate limited.
+    bool setAggregation(const char* action, unsigned long window, unsigned long maxCount = 0);
+    bool addReading(const char* action, const char* field, float value);
+    // sends the action's open window right away
+    bool flushReadings(const char* action);
+
+    virtual void handle();
 
   private:
+    struct deadbandRule {
+      String action;            // empty = unused
+      String field;
+      float absolute;
+      float relative;
+      unsigned long heartbeat;
+      float lastValue;
+      unsigned long lastSent;
+      bool sent;
+    };
+
+    bool passes(const deadbandRule& rule, float value);
+    template <typename Lookup>
+    bool passesDeadband(const char* action, Lookup number);
+    template <typename Lookup>
+    void commitDeadband(const char* action, Lookup number);
+    template <typename Value, typename Lookup>
+    bool sendFiltered(const char* action, const String& cause, const Value& value, Lookup number);
+#ifndef NODEBUG_IOTLINK
+    static void printValue(JsonObject value) { serializeJson(value, DEBUG_ESP_PORT); }
+    static void printValue(const IotLinkRecord& value) { DEBUG_ESP_PORT.print(value.toString()); }
+#endif
+
+    deadbandRule rules[IOTLINK_DEADBAND_RULES];
+
+    struct aggregation {
+      String action;            // empty = unused
+      unsigned long window;
+      unsigned long maxCount;
+      unsigned long start;
+      unsigned long count;      // readings in the open window
+    };
+    struct aggregateField {
+      int aggregation;          // index into aggregations, -1 = unused
+      String field;
+      float min;
+      float max;
+      double sum;
+      float last;
+      unsigned long count;
+    };
+
+    aggregation* findAggregation(const char* action);
+    bool flushAggregation(aggregation& window);
+
+    aggregation aggregations[IOTLINK_AGGREGATIONS];
+    aggregateField aggregateFields[IOTLINK_AGGREGATE_FIELDS];
 };
 
-IotLinkControl::IotLinkControl(const char* deviceId, unsigned long eventWaitTime) : IotLinkDevice(deviceId, eventWaitTime) {}
+template <> struct IotLinkFastPath<IotLinkControl> { static const bool value = true; };
+
+IotLinkControl::IotLinkControl(const char* deviceId, unsigned long eventWaitTime) : IotLinkDevice(deviceId, eventWaitTime) {
+  for (auto& window : aggregations) window.count = 0;
+  for (auto& field : aggregateFields) field.aggregation = -1;
+}
 
 
 bool IotLinkControl::sendSensorEvent(JsonObject value, const char* action, String cause) {
+  return sendFiltered(action, cause, value, [&](const char* field, float& number) {
+    JsonVariant variant = value[field];
+    if (!variant.is<float>()) return false;
+    number = variant.as<float>();
+    return true;
+  });
+}
 
-  DynamicJsonDocument eventMessage = prepareEvent(deviceId, action, cause.c_str());
-  //JsonObject event_value = eventMessage["payload"]["value"];
-  //event_value = value;
-  eventMessage["payload"]["value"] = value;
-  serializeJson(eventMessage, Serial);
-  //Serial.println(event_value);
-  return sendEvent(eventMessage);
-
+bool IotLinkControl::sendSensorEvent(const IotLinkRecord& value, const char* action, String cause) {
+  return sendFiltered(action, cause, value, [&](const char* field, float& number) {
+    return value.getNumber(field, number);
+  });
 }
 
+// raises the event if it passes the deadband; the rules only take the reading as their
+// last sent one once the event went out or is held, a dropped event changes nothing
+template <typename Value, typename Lookup>
+bool IotLinkControl::sendFiltered(const char* action, const String& cause, const Value& value, Lookup number) {
+  if (!passesDeadband(action, number)) return false;
+#ifndef NODEBUG_IOTLINK
+  printValue(value);
+  DEBUG_IOTLINK("\r\n");
 #endif
+  bool sent = raiseEvent(action, cause.c_str(), value);
+  if (sent || isHeld(action)) commitDeadband(action, number);
+  return sent;
+}
+
+bool IotLinkControl::sendSensorSeries(const char* action, const char* field, const IotLinkSeries& series, String cause) {
+  if (!series.size()) return false;
+
+  uint32_t now = millis();
+  size_t size = 6 * strlen(field) + Base64Encoder::updateLen(series.encodedLength(now)) + 24;
+  char* value = (char*) malloc(size);
+  if (!value) return false;
+
+  IotLinkTextWriter out(value, size);
+  out.put("{\"");
+  out.putEscaped(field);
+  out.put("\":{\"series\":\"");
+  out.skip(series.encodeBase64(out.end(), now));
+  out.put("\"}}", 4); // with the NUL
+
+  bool sent = out.length() && raiseEventNow(action, cause.c_str(), value);
+  free(value);
+  return sent;
+}
 
+bool IotLinkControl::setDeadband(const char* action, const char* field, float absolute, float relative, unsigned long heartbeat) {
+  deadbandRule* rule = nullptr;
+  for (auto& candidate : rules) {
+    if (candidate.action == action && candidate.field == field) { rule = &candidate; break; }
+    if (!rule && candidate.action.length() == 0) rule = &candidate;
+  }
+  if (!rule) {
+    DEBUG_IOTLINK("[IotLinkControl:setDeadband()]: no rule left for \"%s\", raise IOTLINK_DEADBAND_RULES\r\n", field);
+    return false;
+  }
+  rule->action = action;
+  rule->field = field;
+  rule->absolute = absolute;
+  rule->relative = relative;
+  rule->heartbeat = heartbeat;
+  rule->sent = false;
+  return true;
+}
+
+bool IotLinkControl::passes(const deadbandRule& rule, float value) {
+  if (!rule.sent) return true;
+  if (rule.heartbeat && millis() - rule.lastSent >= rule.heartbeat) return true;
+
+  float change = fabsf(value - rule.lastValue);
+  if (rule.absolute == 0 && rule.relative == 0) return change != 0;
+  if (rule.absolute > 0 && change > rule.absolute) return true;
+  return rule.relative > 0 && change > rule.relative * fabsf(rule.lastValue);
+}
+
+bool IotLinkControl::hasChanged(const char* action, const char* field, float value) {
+  bool hasRule = false;
+  for (auto& rule : rules) {
+    if (rule.action != action || rule.field != field) continue;
+    if (passes(rule, value)) return true;
+    hasRule = true;
+  }
+  return !hasRule;
+}
+
+// checks the fields of a reading against the action's rules, number(field, value)
+// looks up a numeric field of the reading
+template <typename Lookup>
+bool IotLinkControl::passesDeadband(const char* action, Lookup number) {
+  bool hasRule = false;
+  float value;
+  for (auto& rule : rules) {
+    if (rule.action != action) continue;
+    hasRule = true;
+    if (!number(rule.field.c_str(), value) || passes(rule, value)) return true;
+  }
+  return !hasRule;
+}
+
+// remembers the fields of a sent reading in the action's rules
+template <typename Lookup>
+void IotLinkControl::commitDeadband(const char* action, Lookup number) {
+  float value;
+  unsigned long now = millis();
+  for (auto& rule : rules) {
+    if (rule.action != action) continue;
+    if (!number(rule.field.c_str(), value)) continue;
+    rule.lastValue = value;
+    rule.lastSent = now;
+    rule.sent = true;
+  }
+}
+
+IotLinkControl::aggregation* IotLinkControl::findAggregation(const char* action) {
+  for (auto& window : aggregations) {
+    if (window.action == action) return &window;
+  }
+  return nullptr;
+}
+
+bool IotLinkControl::setAggregation(const char* action, unsigned long window, unsigned long maxCount) {
+  aggregation* entry = findAggregation(action);
+  if (!entry) entry = findAggregation("");
+  if (!entry) {
+    DEBUG_IOTLINK("[IotLinkControl:setAggregation()]: no aggregation left for \"%s\", raise IOTLINK_AGGREGATIONS\r\n", action);
+    return false;
+  }
+  if (entry->count) flushAggregation(*entry);
+
+  // fields of another action are released, those of this one start over
+  int index = entry - aggregations;
+  bool sameAction = entry->action == action;
+  for (auto& field : aggregateFields) {
+    if (field.aggregation != index) continue;
+    if (!sameAction) field.aggregation = -1;
+    field.count = 0;
+  }
+  entry->action = action;
+  entry->window = window;
+  entry->maxCount = maxCount;
+  entry->count = 0;
+  return true;
+}
+
+bool IotLinkControl::addReading(const char* action, const char* field, float value) {
+  aggregation* window = findAggregation(action);
+  if (!window) return false;
+  int index = window - aggregations;
+
+  aggregateField* entry = nullptr;
+  for (auto& candidate : aggregateFields) {
+    if (candidate.aggregation == index && candidate.field == field) { entry = &candidate; break; }
+    if (!entry && candidate.aggregation < 0) entry = &candidate;
+  }
+  if (!entry) {
+    DEBUG_IOTLINK("[IotLinkControl:addReading()]: no field left for \"%s\", raise IOTLINK_AGGREGATE_FIELDS\r\n", field);
+    return false;
+  }
+  if (entry->aggregation < 0) {
+    entry->aggregation = index;
+    entry->field = field;
+    entry->count = 0;
+  }
+
+  if (!window->count) window->start = millis();
+  window->count++;
+  if (!entry->count || value < entry->min) entry->min = value;
+  if (!entry->count || value > entry->max) entry->max = value;
+  entry->sum = entry->count ? entry->sum + value : value;
+  entry->last = value;
+  entry->count++;
+
+  if (window->maxCount && window->count >= window->maxCount) flushAggregation(*window);
+  return true;
+}
+
+bool IotLinkControl::flushReadings(const char* action) {
+  aggregation* window = findAggregation(action);
+  return window && window->count && flushAggregation(*window);
+}
+
+// true if the summary was sent; a held back one closes the window as well,
+// one that was neither sent nor held leaves it open
+bool IotLinkControl::flushAggregation(aggregation& window) {
+  if (isHeld(window.action.c_str())) return false;
+  int index = &window - aggregations;
+  StaticJsonDocument<JSON_OBJECT_SIZE(IOTLINK_AGGREGATE_FIELDS) + IOTLINK_AGGREGATE_FIELDS * JSON_OBJECT_SIZE(5)> doc;
+  JsonObject value = doc.to<JsonObject>();
+
+  for (auto& entry : aggregateFields) {
+    if (entry.aggregation != index || !entry.count) continue;
+    JsonObject summary = value.createNestedObject(entry.field.c_str());
+    summary["min"] = entry.min;
+    summary["max"] = entry.max;
+    summary["mean"] = (float) (entry.sum / entry.count);
+    summary["last"] = entry.last;
+    summary["count"] = entry.count;
+  }
+
+  bool sent = raiseEvent(window.action.c_str(), "PERIODIC_POLL", value);
+  if (!sent && !isHeld(window.action.c_str())) return false;
+  for (auto& entry : aggregateFields) {
+    if (entry.aggregation == index) entry.count = 0;
+  }
+  window.count = 0;
+  return sent;
+}
+
+void IotLinkControl::handle() {
+  for (auto& window : aggregations) {
+    if (!window.count) continue;
+    bool due = (window.window && millis() - window.start >= window.window) || (window.maxCount && window.count >= window.maxCount);
+    if (due) flushAggregation(window);
+  }
+  IotLinkDevice::handle();
+}
+
+#endif
@@ -0,0 +1,358 @@
+#ifndef _IOTLINKDEFLATE_H_
+#define _IOTLINKDEFLATE_H_
+
+// Raw DEFLATE (RFC 1951) of single messages against a preset dictionary.
+//
+// Both sides start every message with the dictionary below as history, so the
+// keys and values every message repeats compress to short back references even
+// in the smallest frames. The window never reaches beyond the dictionary and the
+// message itself, which keeps memory bounded by the message size: there is no
+// 32k sliding window on either side.
+//
+// IotLinkDeflate::compress() writes a single block with the fixed Huffman codes and
+// finds matches through a one entry per bucket hash table. IotLinkDeflate::inflate()
+// accepts any raw deflate stream (stored, fixed and dynamic blocks), e.g. one
+// produced by zlib with windowBits -15 and the same dictionary set via zdict.
+
+#define IOTLINK_DEFLATE_HASH_BITS 9
+#define IOTLINK_DEFLATE_HASH_SIZE (1 << IOTLINK_DEFLATE_HASH_BITS)
+
+// most frequent strings last, they end up with the shortest distances
+static const char iotlinkDeflateDictionary[] =
+  "\"message\":\"OK\",\"success\":false,\"success\":true,\"clientId\":\"\"type\":\"request\""
+  "\"type\":\"response\"PERIODIC_POLL\"timestamp\":"
+  "{\"header\":{\"payloadVersion\":2,\"signatureVersion\":1},\"payload\":{\"action\":\"setPowerState\","
+  "\"cause\":{\"type\":\"PHYSICAL_INTERACTION\"},\"createdAt\":1"
+  ",\"deviceId\":\"\",\"replyToken\":\"\",\"type\":\"event\",\"value\":{\"state\":\"Off\"}}"
+  ",\"signature\":{\"HMAC\":\"";
+
+class IotLinkDeflate {
+  public:
+    // compresses in into out, returns the compressed length or 0 if it would not be
+    // shorter than outSize. head is scratch space of IOTLINK_DEFLATE_HASH_SIZE entries.
+    static size_t compress(const uint8_t* in, size_t length, uint8_t* out, size_t outSize, uint16_t* head);
+    // returns the inflated length or -1 for a broken stream or one that does not fit outSize
+    static long inflate(const uint8_t* in, size_t length, uint8_t* out, size_t outSize);
+
+    static const uint8_t* dictionary() { return (const uint8_t*) iotlinkDeflateDictionary; }
+    static size_t dictionaryLength() { return sizeof(iotlinkDeflateDictionary) - 1; }
+};
+
+static const uint16_t iotlinkDeflateLengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t iotlinkDeflateLengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t iotlinkDeflateDistBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+  4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t iotlinkDeflateDistExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+namespace IotLinkDeflateDetail {
+
+// LSB first bit output as deflate wants it
+struct BitWriter {
+  uint8_t* out;
+  size_t size;
+  size_t pos;
+  uint32_t bits;
+  int count;
+  bool overflow;
+
+  void put(uint32_t value, int n) {
+    bits |= value << count;
+    count += n;
+    while (count >= 8) {
+      if (pos < size) out[pos++] = (uint8_t) bits;
+      else overflow = true;
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+  // Huffman codes go out most significant bit first
+  void putCode(uint32_t code, int n) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < n; i++) { reversed = (reversed << 1) | (code & 1); code >>= 1; }
+    put(reversed, n);
+  }
+  void flush() { if (count) put(0, 8 - count); }
+};
+
+inline void putLiteral(BitWriter& w, int symbol) {
+  if (symbol < 144) w.putCode(0x30 + symbol, 8);
+  else if (symbol < 256) w.putCode(0x190 + symbol - 144, 9);
+  else if (symbol < 280) w.putCode(symbol - 256, 7);
+  else w.putCode(0xc0 + symbol - 280, 8);
+}
+
+inline void putMatch(BitWriter& w, int length, int distance) {
+  int l = 28;
+  while (iotlinkDeflateLengthBase[l] > length) l--;
+  putLiteral(w, 257 + l);
+  w.put(length - iotlinkDeflateLengthBase[l], iotlinkDeflateLengthExtra[l]);
+
+  int d = 29;
+  while (iotlinkDeflateDistBase[d] > distance) d--;
+  w.putCode(d, 5);
+  w.put(distance - iotlinkDeflateDistBase[d], iotlinkDeflateDistExtra[d]);
+}
+
+// dictionary and message as one history
+struct History {
+  const uint8_t* dict;
+  size_t dictLength;
+  const uint8_t* data;
+  size_t length;
+  uint8_t at(size_t pos) const { return pos < dictLength ? dict[pos] : data[pos - dictLength]; }
+  uint32_t hash(size_t pos) const {
+    uint32_t v = (at(pos) << 16) | (at(pos + 1) << 8) | at(pos + 2);
+    return (v * 2654435761u) >> (32 - IOTLINK_DEFLATE_HASH_BITS);
+  }
+};
+
+// Huffman decoding table, symbols ordered by code (canonical codes)
+struct Huffman {
+  uint16_t count[16];
+  uint16_t* symbol;
+};
+
+struct BitReader {
+  const uint8_t* in;
+  size_t length;
+  size_t pos;
+  uint32_t bits;
+  int count;
+  bool error;
+
+  int get(int n) {
+    while (count < n) {
+      if (pos >= length) { error = true; return 0; }
+      bits |= (uint32_t) in[pos++] << count;
+      count += 8;
+    }
+    int value = bits & ((1UL << n) - 1);
+    bits >>= n;
+    count -= n;
+    return value;
+  }
+
+  int decode(const Huffman& h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+      code |= get(1);
+      if (error) return -1;
+      int count = h.count[len];
+      if (code - count < first) return h.symbol[index + (code - first)];
+      index += count;
+      first += count;
+      first <<= 1;
+      code <<= 1;
+    }
+    error = true;
+    return -1;
+  }
+};
+
+// returns 0 for a complete code, > 0 for an incomplete one, < 0 if oversubscribed
+inline int buildHuffman(Huffman& h, const uint8_t* lengths, int n) {
+  uint16_t offs[16];
+  for (int len = 0; len < 16; len++) h.count[len] = 0;
+  for (int s = 0; s < n; s++) h.count[lengths[s]]++;
+  if (h.count[0] == n) return 0;
+
+  int left = 1;
+  for (int len = 1; len < 16; len++) {
+    left <<= 1;
+    left -= h.count[len];
+    if (left < 0) return left;
+  }
+
+  offs[1] = 0;
+  for (int len = 1; len < 15; len++) offs[len + 1] = offs[len] + h.count[len];
+  for (int s = 0; s < n; s++) if (lengths[s]) h.symbol[offs[lengths[s]]++] = s;
+  return left;
+}
+
+struct Output {
+  uint8_t* out;
+  size_t size;
+  size_t pos;
+  const uint8_t* dict;
+  size_t dictLength;
+
+  bool put(uint8_t c) {
+    if (pos >= size) return false;
+    out[pos++] = c;
+    return true;
+  }
+  // back reference into the dictionary followed by the output so far
+  bool copy(size_t distance, size_t length) {
+    if (distance > pos + dictLength || length > size - pos) return false;
+    for (size_t i = 0; i < length; i++) {
+      size_t from = dictLength + pos - distance; // position in dictionary + output
+      out[pos] = from < dictLength ? dict[from] : out[from - dictLength];
+      pos++;
+    }
+    return true;
+  }
+};
+
+inline bool inflateCodes(BitReader& in, Output& out, const Huffman& lencode, const Huffman& distcode) {
+  for (;;) {
+    int symbol = in.decode(lencode);
+    if (symbol < 0) return false;
+    if (symbol < 256) {
+      if (!out.put(symbol)) return false;
+    } else if (symbol == 256) {
+      return true;
+    } else {
+      symbol -= 257;
+      if (symbol >= 29) return false;
+      int length = iotlinkDeflateLengthBase[symbol] + in.get(iotlinkDeflateLengthExtra[symbol]);
+      symbol = in.decode(distcode);
+      if (symbol < 0 || symbol >= 30) return false;
+      int distance = iotlinkDeflateDistBase[symbol] + in.get(iotlinkDeflateDistExtra[symbol]);
+      if (in.error || !out.copy(distance, length)) return false;
+    }
+  }
+}
+
+inline bool inflateStored(BitReader& in, Output& out) {
+  in.bits = 0; // rest of the current byte
+  in.count = 0;
+  if (in.length - in.pos < 4) return false;
+  unsigned len = in.in[in.pos] | (in.in[in.pos + 1] << 8);
+  unsigned nlen = in.in[in.pos + 2] | (in.in[in.pos + 3] << 8);
+  in.pos += 4;
+  if (len != (~nlen & 0xffff) || in.length - in.pos < len) return false;
+  while (len--) if (!out.put(in.in[in.pos++])) return false;
+  return true;
+}
+
+inline bool inflateFixed(BitReader& in, Output& out) {
+  uint16_t lensym[288], distsym[30];
+  uint8_t lengths[288];
+  Huffman lencode = { {0}, lensym }, distcode = { {0}, distsym };
+  int s;
+  for (s = 0; s < 144; s++) lengths[s] = 8;
+  for (; s < 256; s++) lengths[s] = 9;
+  for (; s < 280; s++) lengths[s] = 7;
+  for (; s < 288; s++) lengths[s] = 8;
+  buildHuffman(lencode, lengths, 288);
+  for (s = 0; s < 30; s++) lengths[s] = 5;
+  buildHuffman(distcode, lengths, 30);
+  return inflateCodes(in, out, lencode, distcode);
+}
+
+inline bool inflateDynamic(BitReader& in, Output& out) {
+  static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+  uint16_t lensym[288], distsym[30];
+  uint8_t lengths[288 + 30];
+  Huffman lencode = { {0}, lensym }, distcode = { {0}, distsym };
+
+  int nlen = in.get(5) + 257;
+  int ndist = in.get(5) + 1;
+  int ncode = in.get(4) + 4;
+  if (in.error || nlen > 286 || ndist > 30) return false;
+
+  int index;
+  for (index = 0; index < ncode; index++) lengths[order[index]] = in.get(3);
+  for (; index < 19; index++) lengths[order[index]] = 0;
+  if (in.error || buildHuffman(lencode, lengths, 19) != 0) return false;
+
+  index = 0;
+  while (index < nlen + ndist) {
+    int symbol = in.decode(lencode);
+    if (symbol < 0) return false;
+    if (symbol < 16) {
+      lengths[index++] = symbol;
+      continue;
+    }
+    int len = 0, repeat;
+    if (symbol == 16) {
+      if (index == 0) return false;
+      len = lengths[index - 1];
+      repeat = 3 + in.get(2);
+    } else if (symbol == 17) {
+      repeat = 3 + in.get(3);
+    } else {
+      repeat = 11 + in.get(7);
+    }
+    if (in.error || index + repeat > nlen + ndist) return false;
+    while (repeat--) lengths[index++] = len;
+  }
+  if (lengths[256] == 0) return false; // no end of block code
+
+  int err = buildHuffman(lencode, lengths, nlen);
+  if (err && (err < 0 || nlen != lencode.count[0] + lencode.count[1])) return false;
+  err = buildHuffman(distcode, lengths + nlen, ndist);
+  if (err && (err < 0 || ndist != distcode.count[0] + distcode.count[1])) return false;
+
+  return inflateCodes(in, out, lencode, distcode);
+}
+
+} // namespace IotLinkDeflateDetail
+
+size_t IotLinkDeflate::compress(const uint8_t* in, size_t length, uint8_t* out, size_t outSize, uint16_t* head) {
+  using namespace IotLinkDeflateDetail;
+  const History h = { dictionary(), dictionaryLength(), in, length };
+  const size_t end = h.dictLength + length;
+  if (end >= 0xffff) return 0; // positions are kept in 16 bits
+
+  // head holds position + 1 of the latest string per hash bucket, 0 = none
+  memset(head, 0, IOTLINK_DEFLATE_HASH_SIZE * sizeof(uint16_t));
+  for (size_t pos = 0; pos + 2 < h.dictLength; pos++) head[h.hash(pos)] = pos + 1;
+
+  BitWriter w = { out, outSize, 0, 0, 0, false };
+  w.put(1, 1); // final block
+  w.put(1, 2); // fixed Huffman codes
+
+  size_t pos = h.dictLength;
+  while (pos < end && !w.overflow) {
+    size_t best = 0;
+    if (pos + 2 < end) {
+      uint32_t bucket = h.hash(pos);
+      size_t candidate = head[bucket];
+      head[bucket] = pos + 1;
+      if (candidate-- && pos - candidate <= 32768) { // farthest distance deflate can encode
+        size_t limit = end - pos < 258 ? end - pos : 258;
+        while (best < limit && h.at(candidate + best) == h.at(pos + best)) best++;
+        if (best >= 3) {
+          putMatch(w, best, pos - candidate);
+          for (size_t i = 1; i < best && pos + i + 2 < end; i++) head[h.hash(pos + i)] = pos + i + 1;
+          pos += best;
+          continue;
+        }
+      }
+    }
+    putLiteral(w, h.at(pos));
+    pos++;
+  }
+  putLiteral(w, 256);
+  w.flush();
+  return w.overflow ? 0 : w.pos;
+}
+
+long IotLinkDeflate::inflate(const uint8_t* in, size_t length, uint8_t* out, size_t outSize) {
+  using namespace IotLinkDeflateDetail;
+  BitReader r = { in, length, 0, 0, 0, false };
+  Output o = { out, outSize, 0, dictionary(), dictionaryLength() };
+
+  int last;
+  do {
+    last = r.get(1);
+    int type = r.get(2);
+    if (r.error) return -1;
+    bool ok;
+    switch (type) {
+      case 0: ok = inflateStored(r, o); break;
+      case 1: ok = inflateFixed(r, o); break;
+      case 2: ok = inflateDynamic(r, o); break;
+      default: ok = false;
+    }
+    if (!ok || r.error) return -1;
+  } while (!last);
+  return o.pos;
+}
+
+#endif
@@ -2,6 +2,21 @@
 #define _IOTLINKDEVICE_H_
 
 #include "IotLinkDeviceInterface.h"
+#include "IotLinkAction.h"
+#include "IotLinkLeakyBucket.h"
+
+// Cause and value of an event waiting for the rate limit. The buffers are shared by
+// all devices and only taken while an event is held, so devices that never hit the
+// limit do not pay for them.
+struct IotLinkHeldEvent {
+  bool used;
+  char cause[IOTLINK_EVENT_CAUSE_SIZE];
+  char value[IOTLINK_EVENT_VALUE_SIZE];
+
+  // nullptr once all IOTLINK_HELD_EVENTS are in use
+  static IotLinkHeldEvent* take();
+  void release() { used = false; }
+};
 
 class IotLinkDevice : public IotLinkDeviceInterface {
   public:
@@ -9,14 +24,17 @@ class IotLinkDevice : public IotLinkDeviceInterface {
     virtual ~IotLinkDevice();
     virtual const char* getDeviceId();
     virtual void begin(IotLinkInterface* eventSender);
+    virtual void handle();
     virtual void setEventWaitTime(unsigned long eventWaitTime) { if (eventWaitTime<100) {this->eventWaitTime=100;} else { this->eventWaitTime=eventWaitTime;} }
 
 
     typedef std::function<bool(const String&, bool&)> PowerStateCallback;
     
 
-    // standard request handler
+    // standard request handler, subclasses with own actions override it, dispatch
+    // their own table and hand anything unknown on to IotLinkDevice::handleRequest()
     virtual bool handleRequest(const char* deviceId, const char* action, JsonObject &request_value, JsonObject &response_value);
+    virtual bool handleFastRequest(const IotLinkFastRequest &request, IotLinkTextWriter &response_value, bool &success);
 
     // standard Callbacks
     virtual void onPowerState(PowerStateCallback cb);
@@ -25,15 +43,69 @@ class IotLinkDevice : public IotLinkDeviceInterface {
     bool sendPowerStateEvent(bool state, String cause = "PHYSICAL_INTERACTION");
 
   protected:
+    // Events are rate limited per device by a LeakyBucket and per action by eventWaitTime.
+    // An event that has to wait is held back (the call returns false) and sent from
+    // handle() as soon as it may; a newer event of the same action replaces a held one.
     virtual bool sendEvent(JsonDocument& event);
-    virtual DynamicJsonDocument prepareEvent(const char* deviceId, const char* action, const char* cause);
+    bool raiseEvent(const char* action, const char* cause, const char* value);
+    bool raiseEvent(const char* action, const char* cause, JsonObject value);
+    bool raiseEvent(const char* action, const char* cause, const IotLinkRecord& value);
+    // like raiseEvent(), but an event that has to wait is not held back, for values
+    // the caller keeps until they are sent or too long for IOTLINK_EVENT_VALUE_SIZE
+    bool raiseEventNow(const char* action, const char* cause, const char* value);
+    // true while an event of action is held back
+    bool isHeld(const char* action) const;
+
+    bool sendEvent(const IotLinkEventTemplate& event, const char* cause, const char* value);
+    bool sendEvent(const IotLinkEventTemplate& event, const char* cause, JsonObject value);
+    bool sendEvent(const IotLinkEventTemplate& event, const char* cause, const IotLinkRecord& value);
+    virtual IotLinkMessage prepareEvent(const char* deviceId, const char* action, const char* cause);
     char* deviceId;
     PowerStateCallback powerStateCallback;
+
+    bool handlePowerState(JsonObject &request_value, JsonObject &response_value);
+    bool handlePowerState(const IotLinkFastRequest &request, IotLinkTextWriter &response_value);
+    static const IotLinkAction<IotLinkDevice> actions[];
   private:
+    // A slot is bound to an action on its first event and keeps it, so its template
+    // is rendered once. A held event waits in an IotLinkHeldEvent.
+    struct eventSlot {
+      char action[IOTLINK_EVENT_ACTION_SIZE] = {}; // empty = unused
+      IotLinkEventTemplate event;
+      unsigned long lastEvent = 0;
+      bool sent = false;           // lastEvent is valid
+      IotLinkHeldEvent* held = nullptr;
+    };
+
+    eventSlot* eventSlotFor(const char* action);
+    bool admitEvent(eventSlot* slot, const char* action);
+    template <typename Writer>
+    void holdEvent(eventSlot& slot, const char* cause, Writer write);
+    void resendHeld(eventSlot& slot);
+    bool transmitEvent(eventSlot* slot, const char* action, const char* cause, const char* value);
+    bool transmitEvent(eventSlot* slot, const char* action, const char* cause, JsonObject value);
+    bool transmitEvent(eventSlot* slot, const char* action, const char* cause, const IotLinkRecord& value);
+    bool deliverEvent(JsonDocument& event);
+    bool admitReplay() override { return eventBucket.addDrop(false); }
+
     IotLinkInterface* eventSender;
     unsigned long eventWaitTime;
+    LeakyBucket eventBucket;
+    eventSlot eventSlots[IOTLINK_EVENT_SLOTS];
 };
 
+template <> struct IotLinkFastPath<IotLinkDevice> { static const bool value = true; };
+
+IotLinkHeldEvent* IotLinkHeldEvent::take() {
+  static IotLinkHeldEvent pool[IOTLINK_HELD_EVENTS];
+  for (auto& entry : pool) {
+    if (entry.used) continue;
+    entry.used = true;
+    return &entry;
+  }
+  return nullptr;
+}
+
 IotLinkDevice::IotLinkDevice(const char* newDeviceId, unsigned long eventWaitTime) : 
   powerStateCallback(nullptr),
   eventSender(nullptr),
@@ -44,6 +116,9 @@ IotLinkDevice::IotLinkDevice(const char* newDeviceId, unsigned long eventWaitTim
 
 IotLinkDevice::~IotLinkDevice() {
   if (deviceId) free(deviceId);
+  for (auto& slot : eventSlots) {
+    if (slot.held) slot.held->release();
+  }
 }
 
 void IotLinkDevice::begin(IotLinkInterface* eventSender) {
@@ -54,40 +129,275 @@ const char* IotLinkDevice::getDeviceId() {
   return deviceId;
 }
 
+const IotLinkAction<IotLinkDevice> IotLinkDevice::actions[] = {
+  IOTLINK_FAST_ACTION("setPowerState", &IotLinkDevice::handlePowerState, &IotLinkDevice::handlePowerState),
+};
+
 bool IotLinkDevice::handleRequest(const char* deviceId, const char* action, JsonObject &request_value, JsonObject &response_value) {
   if (strcmp(deviceId, this->deviceId) != 0) return false;
   DEBUG_IOTLINK("IotLinkDevice::handleRequest()\r\n");
   bool success = false;
-  String actionString = String(action);
-  //Serial.println(actionString);
-  if (actionString == "setPowerState" && powerStateCallback) {
-    bool powerState = request_value["state"]=="On"?true:false;
-    success = powerStateCallback(String(deviceId), powerState);
-    response_value["state"] = powerState?"On":"Off";
-    return success;
-  }
+  dispatchAction(this, actions, action, request_value, response_value, success);
+  return success;
+}
+
+// only for devices that opted in through IotLinkFastPath, an override of handleRequest() must see every request
+bool IotLinkDevice::handleFastRequest(const IotLinkFastRequest &request, IotLinkTextWriter &response_value, bool &success) {
+  if (!fastPath || !request.deviceId.equals(this->deviceId)) return false;
+  DEBUG_IOTLINK("IotLinkDevice::handleFastRequest()\r\n");
+  return dispatchFastAction(this, actions, request, response_value, success);
+}
+
+bool IotLinkDevice::handlePowerState(JsonObject &request_value, JsonObject &response_value) {
+  if (!powerStateCallback) return false;
+  bool powerState = request_value["state"]=="On"?true:false;
+  bool success = powerStateCallback(String(deviceId), powerState);
+  response_value["state"] = powerState?"On":"Off";
   return success;
 }
 
-DynamicJsonDocument IotLinkDevice::prepareEvent(const char* deviceId, const char* action, const char* cause) {
+bool IotLinkDevice::handlePowerState(const IotLinkFastRequest &request, IotLinkTextWriter &response_value) {
+  if (!powerStateCallback) return false;
+  IotLinkStringView state;
+  bool powerState = request.getString("state", state) && state.equals("On");
+  bool success = powerStateCallback(String(deviceId), powerState);
+  response_value.put(powerState?"\"state\":\"On\"":"\"state\":\"Off\"");
+  return success;
+}
+
+IotLinkMessage IotLinkDevice::prepareEvent(const char* deviceId, const char* action, const char* cause) {
   if (eventSender) return eventSender->prepareEvent(deviceId, action, cause);
   DEBUG_IOTLINK("[IotLinkDevice:prepareEvent()]: Device \"%s\" isn't configured correctly! The \'%s\' event will be ignored.\r\n", deviceId, action);
-  return DynamicJsonDocument(1024);
+  return IotLinkMessage(new DynamicJsonDocument(1024));
 }
 
 
 bool IotLinkDevice::sendEvent(JsonDocument& event) {
+  if (!eventSender) return false;
+
+  const char* action = event["payload"]["action"] | "";
+  eventSlot* slot = eventSlotFor(action);
+  if (admitEvent(slot, action)) return deliverEvent(event);
+  if (!slot) return false;
+
+  JsonVariant value = event["payload"]["value"];
+  holdEvent(*slot, event["payload"]["cause"]["type"] | "", [&](char* buffer, size_t size) -> size_t {
+    size_t length = measureJson(value);
+    if (length > size) return 0;
+    return serializeJson(value, buffer, length + 1);
+  });
+  return false;
+}
+
+bool IotLinkDevice::raiseEvent(const char* action, const char* cause, const char* value) {
+  if (!eventSender) {
+    DEBUG_IOTLINK("[IotLinkDevice:raiseEvent()]: Device \"%s\" isn't configured correctly! The \'%s\' event will be ignored.\r\n", deviceId, action);
+    return false;
+  }
+  if (!fastPath) {
+    IotLinkMessage event = prepareEvent(deviceId, action, cause);
+    event["payload"]["value"] = serialized(value);
+    return sendEvent(event);
+  }
+  eventSlot* slot = eventSlotFor(action);
+  if (admitEvent(slot, action)) return transmitEvent(slot, action, cause, value);
+  if (!slot) return false;
 
-  String eventName = event["payload"]["action"] | "";
+  holdEvent(*slot, cause, [&](char* buffer, size_t size) -> size_t {
+    size_t length = strlen(value);
+    if (length > size) return 0;
+    memcpy(buffer, value, length);
+    return length;
+  });
+  return false;
+}
+
+bool IotLinkDevice::raiseEventNow(const char* action, const char* cause, const char* value) {
+  if (!eventSender) {
+    DEBUG_IOTLINK("[IotLinkDevice:raiseEventNow()]: Device \"%s\" isn't configured correctly! The \'%s\' event will be ignored.\r\n", deviceId, action);
+    return false;
+  }
+  eventSlot* slot = eventSlotFor(action);
+  if (!admitEvent(slot, action)) return false;
+  return transmitEvent(fastPath ? slot : nullptr, action, cause, value);
+}
 
-    if (eventSender) {
-		//serializeJson(event, Serial);
-		eventSender->sendMessage(event);
-        return true;
-	}
+bool IotLinkDevice::raiseEvent(const char* action, const char* cause, JsonObject value) {
+  if (!eventSender) {
+    DEBUG_IOTLINK("[IotLinkDevice:raiseEvent()]: Device \"%s\" isn't configured correctly! The \'%s\' event will be ignored.\r\n", deviceId, action);
+    return false;
+  }
+  if (!fastPath) {
+    IotLinkMessage event = prepareEvent(deviceId, action, cause);
+    event["payload"]["value"] = value;
+    return sendEvent(event);
+  }
+  eventSlot* slot = eventSlotFor(action);
+  if (admitEvent(slot, action)) return transmitEvent(slot, action, cause, value);
+  if (!slot) return false;
 
+  holdEvent(*slot, cause, [&](char* buffer, size_t size) -> size_t {
+    size_t length = measureJson(value);
+    if (length > size) return 0;
+    return serializeJson(value, buffer, length + 1);
+  });
   return false;
+}
+
+bool IotLinkDevice::raiseEvent(const char* action, const char* cause, const IotLinkRecord& value) {
+  if (!eventSender) {
+    DEBUG_IOTLINK("[IotLinkDevice:raiseEvent()]: Device \"%s\" isn't configured correctly! The \'%s\' event will be ignored.\r\n", deviceId, action);
+    return false;
+  }
+  if (!fastPath) {
+    IotLinkMessage event = prepareEvent(deviceId, action, cause);
+    event["payload"]["value"] = serialized(value.toString());
+    return sendEvent(event);
+  }
+  eventSlot* slot = eventSlotFor(action);
+  if (admitEvent(slot, action)) return transmitEvent(slot, action, cause, value);
+  if (!slot) return false;
+
+  holdEvent(*slot, cause, [&](char* buffer, size_t size) -> size_t {
+    IotLinkTextWriter out(buffer, size);
+    value.write(out);
+    return out.length();
+  });
+  return false;
+}
+
+void IotLinkDevice::handle() {
+  for (auto& slot : eventSlots) {
+    if (!slot.held) continue;
+    if (slot.sent && millis() - slot.lastEvent < eventWaitTime) continue;
+    if (!fastPath) {
+      if (!eventBucket.canDrop()) return;
+      resendHeld(slot);
+      continue;
+    }
+    if (!eventBucket.addDrop()) return;
+
+    IotLinkHeldEvent* held = slot.held;
+    slot.held = nullptr;
+    slot.sent = true;
+    slot.lastEvent = millis();
+    DEBUG_IOTLINK("[IotLinkDevice:handle()]: sending held \'%s\' event\r\n", slot.action);
+    transmitEvent(&slot, slot.action, held->cause, held->value);
+    held->release();
+  }
+}
+
+// Devices that take the JsonDocument way get their held event rebuilt with
+// prepareEvent() and passed to the virtual sendEvent() again, like the first time.
+void IotLinkDevice::resendHeld(eventSlot& slot) {
+  char cause[IOTLINK_EVENT_CAUSE_SIZE];
+  IotLinkHeldEvent* held = slot.held;
+  slot.held = nullptr;
+  memcpy(cause, held->cause, sizeof(cause));
+  DEBUG_IOTLINK("[IotLinkDevice:handle()]: sending held \'%s\' event\r\n", slot.action);
+
+  IotLinkMessage event = prepareEvent(deviceId, slot.action, cause);
+  event["payload"]["value"] = serialized((char*) held->value); // char* is copied, the buffer is released
+  held->release();
+  sendEvent(event);
+}
+
+// slot of action, binding the next unused one on its first event; nullptr once all
+// slots belong to other actions (or the name does not fit IOTLINK_EVENT_ACTION_SIZE)
+IotLinkDevice::eventSlot* IotLinkDevice::eventSlotFor(const char* action) {
+  size_t length = strlen(action);
+  if (!length || length >= IOTLINK_EVENT_ACTION_SIZE) return nullptr;
+  for (auto& slot : eventSlots) {
+    if (strcmp(slot.action, action) == 0) return &slot;
+    if (slot.action[0]) continue;
+    if (!slot.event.begin(deviceId, action)) return nullptr;
+    memcpy(slot.action, action, length + 1);
+    return &slot;
+  }
+  return nullptr;
+}
+
+bool IotLinkDevice::isHeld(const char* action) const {
+  for (auto& slot : eventSlots) {
+    if (strcmp(slot.action, action) == 0) return slot.held != nullptr;
+  }
+  return false;
+}
+
+// events of an action without a slot are only limited by the bucket and never held
+bool IotLinkDevice::admitEvent(eventSlot* slot, const char* action) {
+  if (!slot) {
+    DEBUG_IOTLINK("[IotLinkDevice]: no event slot for \'%s\', raise IOTLINK_EVENT_SLOTS\r\n", action);
+    return eventBucket.addDrop();
+  }
+  if (slot->held) return false; // an older event is still waiting, the new one takes its place
+  if (slot->sent && millis() - slot->lastEvent < eventWaitTime) return false;
+  if (!eventBucket.addDrop()) return false;
+  slot->sent = true;
+  slot->lastEvent = millis();
+  return true;
+}
+
+// write(buffer, size) renders the value into buffer and returns its length, 0 if it needs more than size bytes
+template <typename Writer>
+void IotLinkDevice::holdEvent(eventSlot& slot, const char* cause, Writer write) {
+  IotLinkHeldEvent* held = slot.held ? slot.held : IotLinkHeldEvent::take();
+  if (!held) {
+    DEBUG_IOTLINK("[IotLinkDevice]: no buffer to hold the \'%s\' event, raise IOTLINK_HELD_EVENTS\r\n", slot.action);
+    return;
+  }
+  size_t causeLength = strlen(cause);
+  size_t length = causeLength < sizeof(held->cause) ? write(held->value, sizeof(held->value) - 1) : 0;
+  if (!length) {
+    DEBUG_IOTLINK("[IotLinkDevice]: \'%s\' event does not fit IOTLINK_EVENT_VALUE_SIZE and is dropped\r\n", slot.action);
+    held->release();
+    slot.held = nullptr;
+    return;
+  }
+  DEBUG_IOTLINK("[IotLinkDevice]: \'%s\' event %s\r\n", slot.action, slot.held ? "replaces the held one" : "is held back");
+  held->value[length] = '\0';
+  memcpy(held->cause, cause, causeLength + 1);
+  slot.held = held;
+}
+
+bool IotLinkDevice::transmitEvent(eventSlot* slot, const char* action, const char* cause, const char* value) {
+  if (slot && sendEvent(slot->event, cause, value)) return true;
+
+  IotLinkMessage eventMessage = prepareEvent(deviceId, action, cause);
+  eventMessage["payload"]["value"] = serialized(value);
+  return deliverEvent(eventMessage);
+}
+
+bool IotLinkDevice::transmitEvent(eventSlot* slot, const char* action, const char* cause, JsonObject value) {
+  if (slot && sendEvent(slot->event, cause, value)) return true;
+
+  IotLinkMessage eventMessage = prepareEvent(deviceId, action, cause);
+  eventMessage["payload"]["value"] = value;
+  return deliverEvent(eventMessage);
+}
+
+bool IotLinkDevice::transmitEvent(eventSlot* slot, const char* action, const char* cause, const IotLinkRecord& value) {
+  if (slot && sendEvent(slot->event, cause, value)) return true;
+  return transmitEvent(nullptr, action, cause, value.toString().c_str());
+}
+
+bool IotLinkDevice::deliverEvent(JsonDocument& event) {
+  if (!eventSender) return false;
+  //serializeJson(event, Serial);
+  return eventSender->sendMessage(event);
+}
+
+// template based events, false if there is no sender or the event did not fit and has to go the JsonDocument way
+bool IotLinkDevice::sendEvent(const IotLinkEventTemplate& event, const char* cause, const char* value) {
+  return eventSender && eventSender->sendEvent(event, cause, value);
+}
+
+bool IotLinkDevice::sendEvent(const IotLinkEventTemplate& event, const char* cause, JsonObject value) {
+  return eventSender && eventSender->sendEvent(event, cause, value);
+}
 
+bool IotLinkDevice::sendEvent(const IotLinkEventTemplate& event, const char* cause, const IotLinkRecord& value) {
+  return eventSender && eventSender->sendEvent(event, cause, value);
 }
 
 void IotLinkDevice::onPowerState(PowerStateCallback cb) { 
@@ -96,10 +406,7 @@ void IotLinkDevice::onPowerState(PowerStateCallback cb) {
 
 
 bool IotLinkDevice::sendPowerStateEvent(bool state, String cause) {
-  DynamicJsonDocument eventMessage = prepareEvent(deviceId, "setPowerState", cause.c_str());
-  JsonObject event_value = eventMessage["payload"]["value"];
-  event_value["state"] = state?"On":"Off";
-  return sendEvent(eventMessage);
+  return raiseEvent("setPowerState", cause.c_str(), state ? "{\"state\":\"On\"}" : "{\"state\":\"Off\"}");
 }
 
 #endif
\ No newline at end of file
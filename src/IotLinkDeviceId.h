@@ -0,0 +1,88 @@
+#ifndef __DEVICEID_H__
+#define __DEVICEID_H__
+
+#define DEVICEID_LENGTH 24 // hex characters on the wire
+
+// Device id packed into its 12 raw bytes. Parsing validates and converts eight hex
+// characters per step (SWAR on a 64 bit word), ids compare and hash as three
+// integers, and toString() formats them back to lowercase hex for the wire. Only
+// the lowercase wire form parses, so two ids are equal exactly when their text is.
+class DeviceId {
+public:
+  DeviceId() : valid(false) { words[0] = words[1] = words[2] = 0; }
+  explicit DeviceId(const char* text) : DeviceId() { parse(text); }
+
+  // false (and invalid) unless text is exactly DEVICEID_LENGTH lowercase hex characters
+  bool parse(const char* text);
+  bool isValid() const { return valid; }
+  static bool isValid(const char* text) { return DeviceId(text).isValid(); }
+
+  bool operator==(const DeviceId& other) const { return valid && other.valid && words[0] == other.words[0] && words[1] == other.words[1] && words[2] == other.words[2]; }
+  bool operator!=(const DeviceId& other) const { return !(*this == other); }
+  uint32_t hash() const;
+
+  const uint8_t* bytes() const { return (const uint8_t*) words; }
+  void toString(char text[DEVICEID_LENGTH + 1]) const;
+
+private:
+  static bool parseWord(const char* text, uint32_t& word);
+  uint32_t words[3]; // the id bytes in wire order
+  bool valid;
+};
+
+// eight hex characters into four bytes, in memory order
+bool DeviceId::parseWord(const char* text, uint32_t& word) {
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t high = 0x8080808080808080ULL;
+
+  uint64_t x;
+  memcpy(&x, text, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  x = __builtin_bswap64(x); // first character in the lowest byte
+#endif
+  if (x & high) return false;
+
+  // with bit 7 clear in every byte these sums never carry into the next byte
+  uint64_t lower = x | (0x20 * ones);
+  uint64_t digit = (x + (0x80 - '0') * ones) & ~(x + (0x7f - '9') * ones) & high;
+  uint64_t alpha = (lower + (0x80 - 'a') * ones) & ~(lower + (0x7f - 'f') * ones) & high;
+  if ((digit | alpha) != high) return false;
+  if (alpha & ~(x << 2)) return false; // a letter without 0x20 set is uppercase
+
+  // nibble value per byte, then pairs of nibbles into bytes and bytes together
+  uint64_t nibbles = (x & (0x0f * ones)) + (alpha >> 7) * 9;
+  uint64_t pairs = ((nibbles & 0x000f000f000f000fULL) << 4) | ((nibbles >> 8) & 0x000f000f000f000fULL);
+  pairs = (pairs | (pairs >> 8)) & 0x0000ffff0000ffffULL;
+  pairs = (pairs | (pairs >> 16)) & 0x00000000ffffffffULL;
+
+  uint8_t packed[4] = { (uint8_t) pairs, (uint8_t) (pairs >> 8), (uint8_t) (pairs >> 16), (uint8_t) (pairs >> 24) };
+  memcpy(&word, packed, sizeof(word));
+  return true;
+}
+
+bool DeviceId::parse(const char* text) {
+  valid = text && strnlen(text, DEVICEID_LENGTH + 1) == DEVICEID_LENGTH &&
+          parseWord(text, words[0]) && parseWord(text + 8, words[1]) && parseWord(text + 16, words[2]);
+  if (!valid) words[0] = words[1] = words[2] = 0;
+  return valid;
+}
+
+uint32_t DeviceId::hash() const {
+  uint32_t h = words[0] ^ (words[1] * 0x9e3779b1u) ^ (words[2] * 0x85ebca77u);
+  h ^= h >> 16;
+  h *= 0x7feb352du;
+  h ^= h >> 15;
+  return h;
+}
+
+void DeviceId::toString(char text[DEVICEID_LENGTH + 1]) const {
+  static const char hex[] = "0123456789abcdef";
+  const uint8_t* b = bytes();
+  for (int i = 0; i < 12; i++) {
+    *text++ = hex[b[i] >> 4];
+    *text++ = hex[b[i] & 0x0f];
+  }
+  *text = '\0';
+}
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef _IOTLINKDEVICEINDEX_H_
+#define _IOTLINKDEVICEINDEX_H_
+
+#include "IotLinkDeviceInterface.h"
+#include "IotLinkDeviceId.h"
+
+// Open addressing hash index from device id to device, shared by IotLinkClass and
+// websocketListener. Linear probing over a power of two table kept at most half
+// full. A slot keeps the packed DeviceId of its device, so a well formed id is
+// parsed once per lookup and compared as three integers. Any other id text is
+// hashed with FNV-1a and compared with strcmp against the device's own id. Both
+// match exactly like IotLinkDevice::handleRequest() does. Devices are never removed.
+class IotLinkDeviceIndex {
+  public:
+    IotLinkDeviceIndex() : slots(nullptr), capacity(0), count(0) {}
+    ~IotLinkDeviceIndex() { free(slots); }
+    IotLinkDeviceIndex(const IotLinkDeviceIndex&) = delete;
+    IotLinkDeviceIndex& operator=(const IotLinkDeviceIndex&) = delete;
+
+    // returns false if a device with the same id is already indexed (the first one wins)
+    bool add(IotLinkDeviceInterface* device);
+    IotLinkDeviceInterface* find(const char* deviceId) const;
+    IotLinkDeviceInterface* find(const DeviceId& id, const char* deviceId) const;
+    size_t size() const { return count; }
+
+  private:
+    struct slot {
+      uint32_t hash;
+      DeviceId id;                    // invalid for ids that are not packed
+      IotLinkDeviceInterface* device; // nullptr = empty
+    };
+
+    static uint32_t hash(const DeviceId& id, const char* deviceId);
+    static bool matches(const slot& s, uint32_t h, const DeviceId& id, const char* deviceId);
+    bool grow();
+
+    slot* slots;
+    size_t capacity;
+    size_t count;
+};
+
+uint32_t IotLinkDeviceIndex::hash(const DeviceId& id, const char* deviceId) {
+  if (id.isValid()) return id.hash();
+  uint32_t h = 2166136261u; // FNV-1a
+  while (*deviceId) h = (h ^ (uint8_t) *deviceId++) * 16777619u;
+  return h;
+}
+
+bool IotLinkDeviceIndex::matches(const slot& s, uint32_t h, const DeviceId& id, const char* deviceId) {
+  if (s.hash != h) return false;
+  if (id.isValid()) return s.id == id;
+  return !s.id.isValid() && strcmp(s.device->getDeviceId(), deviceId) == 0;
+}
+
+bool IotLinkDeviceIndex::grow() {
+  size_t newCapacity = capacity ? capacity * 2 : 8;
+  slot* newSlots = (slot*) calloc(newCapacity, sizeof(slot));
+  if (!newSlots) return false;
+
+  for (size_t i = 0; i < capacity; i++) {
+    if (!slots[i].device) continue;
+    size_t j = slots[i].hash & (newCapacity - 1);
+    while (newSlots[j].device) j = (j + 1) & (newCapacity - 1);
+    newSlots[j] = slots[i];
+  }
+  free(slots);
+  slots = newSlots;
+  capacity = newCapacity;
+  return true;
+}
+
+bool IotLinkDeviceIndex::add(IotLinkDeviceInterface* device) {
+  if ((count + 1) * 2 > capacity && !grow()) return false;
+
+  const char* deviceId = device->getDeviceId();
+  DeviceId id(deviceId);
+  uint32_t h = hash(id, deviceId);
+  size_t i = h & (capacity - 1);
+  while (slots[i].device) {
+    if (matches(slots[i], h, id, deviceId)) return false;
+    i = (i + 1) & (capacity - 1);
+  }
+  slots[i].hash = h;
+  slots[i].id = id;
+  slots[i].device = device;
+  count++;
+  return true;
+}
+
+IotLinkDeviceInterface* IotLinkDeviceIndex::find(const char* deviceId) const {
+  if (!deviceId || !count) return nullptr;
+  return find(DeviceId(deviceId), deviceId);
+}
+
+// deviceId is only read for ids that did not parse
+IotLinkDeviceInterface* IotLinkDeviceIndex::find(const DeviceId& id, const char* deviceId) const {
+  if (!count) return nullptr;
+
+  uint32_t h = hash(id, deviceId);
+  size_t i = h & (capacity - 1);
+  while (slots[i].device) {
+    if (matches(slots[i], h, id, deviceId)) return slots[i].device;
+    i = (i + 1) & (capacity - 1);
+  }
+  return nullptr;
+}
+
+#endif
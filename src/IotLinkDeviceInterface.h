@@ -2,15 +2,31 @@
 #define _IOTLINKDEVICEINTERFACE_
 
 #include <IotlinkInterface.h>
+#include "IotLinkRequest.h"
 
 class IotLinkDeviceInterface {
   public:
     virtual bool handleRequest(const char* deviceId, const char* action, JsonObject &request_value, JsonObject &response_value) = 0;
+    // request handling without a JsonDocument, false if the request has to take the handleRequest() way
+    virtual bool handleFastRequest(const IotLinkFastRequest &request, IotLinkTextWriter &response_value, bool &success) { return false; }
     virtual const char* getDeviceId() = 0;
     virtual void begin(IotLinkInterface* eventSender) = 0;
+    // called from IotLink.handle()
+    virtual void handle() {}
   protected:
+    friend class IotLinkClass;
     virtual bool sendEvent(JsonDocument& event) = 0;
-    virtual DynamicJsonDocument prepareEvent(const char* deviceId, const char* action, const char* cause) = 0;
+    virtual IotLinkMessage prepareEvent(const char* deviceId, const char* action, const char* cause) = 0;
+    // rate limit of the device for a journaled event replayed on its behalf
+    virtual bool admitReplay() { return true; }
+    bool fastPath = false; // set from IotLinkFastPath by IotLink.add<DeviceType>()
 };
 
+// Classes whose request and event handling the library knows completely. Only
+// devices of exactly these types take the shortcuts around JsonDocument (templates
+// for events, the fast request path). A subclass can override handleRequest() or
+// sendEvent(JsonDocument&) and takes the JsonDocument ways, unless it specializes
+// this for itself.
+template <typename DeviceType> struct IotLinkFastPath { static const bool value = false; };
+
 #endif
\ No newline at end of file
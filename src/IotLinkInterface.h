@@ -2,11 +2,18 @@
 #define _IOTLINK_INTERFACE_H_
 
 #include "ArduinoJson.h"
+#include "IotLinkMessagePool.h"
+#include "IotLinkMessageTemplate.h"
+#include "IotLinkSchema.h"
 
 class IotLinkInterface {
   public:
-    virtual void sendMessage(JsonDocument& jsonEvent);
-    virtual DynamicJsonDocument prepareEvent(const char* deviceId, const char* action, const char* cause);
+    // false if the message was dropped
+    virtual bool sendMessage(JsonDocument& jsonEvent);
+    virtual IotLinkMessage prepareEvent(const char* deviceId, const char* action, const char* cause);
+    virtual bool sendEvent(const IotLinkEventTemplate& event, const char* cause, const char* value);
+    virtual bool sendEvent(const IotLinkEventTemplate& event, const char* cause, JsonObject value);
+    virtual bool sendEvent(const IotLinkEventTemplate& event, const char* cause, const IotLinkRecord& value);
 };
 
 
@@ -0,0 +1,340 @@
+#ifndef _IOTLINKJOURNAL_H_
+#define _IOTLINKJOURNAL_H_
+
+#include "IotLinkConfig.h"
+#include "IotLinkDebug.h"
+
+#if defined(ESP8266) || defined(ESP32)
+#define IOTLINK_JOURNAL_LITTLEFS 1
+#include <LittleFS.h>
+#else
+#define IOTLINK_JOURNAL_LITTLEFS 0
+#include <stdio.h>
+#include <sys/stat.h>
+#endif
+
+// Append-only journal of event payloads that survives resets.
+//
+// Records ([0xa5][length, 2 bytes][crc32, 4 bytes][payload]) are appended to
+// numbered segment files of about IOTLINK_JOURNAL_SEGMENT_SIZE bytes. Nothing is
+// ever rewritten in place: a segment is deleted as a whole once it has been
+// replayed, and the index file holding the oldest segment number is only written
+// when that happens, so flash is written about once per record: append() gets the
+// payload behind room for the header and writes the record with a single write and
+// flush. A torn record (power loss or a failed write while appending) ends its
+// segment, appending continues in the next one.
+//
+// Replay is at least once: a segment that was partly replayed before a reset is
+// replayed again from its start.
+class IotLinkJournal {
+  public:
+    IotLinkJournal() : ready(false), writer(), readSeq(0), readOffset(0), writeSeq(0), writeSize(0), pendingLength(0) {}
+    ~IotLinkJournal() { end(); }
+
+    bool begin(const char* directory = IOTLINK_JOURNAL_DIRECTORY);
+    void end();
+    bool isReady() const { return ready; }
+
+    static const size_t recordHeaderSize = 7;
+
+    // record holds recordHeaderSize free bytes followed by the payload of length bytes
+    bool append(char* record, size_t length);
+    // copy the oldest record into buffer, returns its length or 0 if there is none;
+    // records longer than size are skipped
+    size_t peek(char* buffer, size_t size);
+    // remove the record returned by peek()
+    void consume();
+    bool empty() const { return !ready || (readSeq == writeSeq && readOffset >= writeSize); }
+
+  private:
+#if IOTLINK_JOURNAL_LITTLEFS
+    typedef File Handle;
+#else
+    typedef FILE* Handle;
+#endif
+    static uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+    // size of the valid records at the start of a segment
+    size_t validLength(unsigned long seq);
+    void segmentPath(unsigned long seq, char* path) const;
+    void indexPath(char* path) const;
+    void writeIndex();
+    void retireSegment();
+    bool nextSegment();
+
+    static bool fileExists(const char* path);
+    static void removeFile(const char* path);
+    static Handle openFile(const char* path, const char* mode);
+    static bool isOpen(Handle& file);
+    static void closeFile(Handle& file);
+    static size_t fileSize(Handle& file);
+    static size_t readAt(Handle& file, size_t offset, void* buffer, size_t length);
+    static bool writeFlush(Handle& file, const void* buffer, size_t length);
+
+    bool ready;
+    char directory[32];
+    Handle writer;
+    unsigned long readSeq;   // oldest segment
+    size_t readOffset;
+    unsigned long writeSeq;  // segment appended to
+    size_t writeSize;
+    size_t pendingLength;    // record returned by peek()
+};
+
+uint32_t IotLinkJournal::crc32(const uint8_t* data, size_t length, uint32_t crc) {
+  static const uint32_t table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+  };
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = table[(crc ^ data[i]) & 0x0f] ^ (crc >> 4);
+    crc = table[(crc ^ (data[i] >> 4)) & 0x0f] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+#if IOTLINK_JOURNAL_LITTLEFS
+bool IotLinkJournal::fileExists(const char* path) { return LittleFS.exists(path); }
+void IotLinkJournal::removeFile(const char* path) { LittleFS.remove(path); }
+IotLinkJournal::Handle IotLinkJournal::openFile(const char* path, const char* mode) { return LittleFS.open(path, mode); }
+bool IotLinkJournal::isOpen(Handle& file) { return (bool) file; }
+void IotLinkJournal::closeFile(Handle& file) { if (file) file.close(); }
+size_t IotLinkJournal::fileSize(Handle& file) { return file.size(); }
+
+size_t IotLinkJournal::readAt(Handle& file, size_t offset, void* buffer, size_t length) {
+  if (!file.seek(offset)) return 0;
+  return file.read((uint8_t*) buffer, length);
+}
+
+bool IotLinkJournal::writeFlush(Handle& file, const void* buffer, size_t length) {
+  if (file.write((const uint8_t*) buffer, length) != length) return false;
+  file.flush();
+  return true;
+}
+#else
+bool IotLinkJournal::fileExists(const char* path) { struct stat st; return stat(path, &st) == 0; }
+void IotLinkJournal::removeFile(const char* path) { remove(path); }
+IotLinkJournal::Handle IotLinkJournal::openFile(const char* path, const char* mode) { return fopen(path, mode); }
+bool IotLinkJournal::isOpen(Handle& file) { return file != nullptr; }
+void IotLinkJournal::closeFile(Handle& file) { if (file) fclose(file); file = nullptr; }
+size_t IotLinkJournal::fileSize(Handle& file) { return fseek(file, 0, SEEK_END) == 0 ? ftell(file) : 0; }
+
+size_t IotLinkJournal::readAt(Handle& file, size_t offset, void* buffer, size_t length) {
+  if (fseek(file, offset, SEEK_SET) != 0) return 0;
+  return fread(buffer, 1, length, file);
+}
+
+bool IotLinkJournal::writeFlush(Handle& file, const void* buffer, size_t length) {
+  // peek() reads through the same stream, C wants a positioning call before writing
+  if (fseek(file, 0, SEEK_END) != 0 || fwrite(buffer, 1, length, file) != length) return false;
+  return fflush(file) == 0;
+}
+#endif
+
+void IotLinkJournal::segmentPath(unsigned long seq, char* path) const {
+  snprintf(path, 48, "%s/%08lx.log", directory, seq);
+}
+
+void IotLinkJournal::indexPath(char* path) const {
+  snprintf(path, 48, "%s/index", directory);
+}
+
+bool IotLinkJournal::begin(const char* directory) {
+  end();
+  if (strlen(directory) >= sizeof(this->directory) - 14) return false;
+  strcpy(this->directory, directory);
+
+#if IOTLINK_JOURNAL_LITTLEFS
+#if defined(ESP32)
+  if (!LittleFS.begin(true)) return false;
+#else
+  if (!LittleFS.begin()) return false;
+#endif
+  if (!LittleFS.exists(directory)) LittleFS.mkdir(directory);
+#else
+  mkdir(directory, 0755);
+#endif
+
+  char path[48];
+  readSeq = 0;
+  indexPath(path);
+  Handle index = openFile(path, "r");
+  if (isOpen(index)) {
+    char text[12] = {0};
+    readAt(index, 0, text, sizeof(text) - 1);
+    readSeq = strtoul(text, nullptr, 16);
+    closeFile(index);
+  }
+
+  // the newest segment is the last one present after the oldest
+  writeSeq = readSeq;
+  for (;;) {
+    segmentPath(writeSeq + 1, path);
+    if (!fileExists(path)) break;
+    writeSeq++;
+  }
+
+  // a segment ending in a torn record is closed, appending continues in a new one
+  segmentPath(writeSeq, path);
+  writeSize = validLength(writeSeq);
+  Handle probe = openFile(path, "r");
+  size_t segmentSize = isOpen(probe) ? fileSize(probe) : 0;
+  closeFile(probe);
+  if (segmentSize > writeSize) {
+    DEBUG_IOTLINK("[IotLink:Journal]: segment %lu ends in a torn record\r\n", writeSeq);
+    writeSeq++;
+    writeSize = 0;
+    segmentPath(writeSeq, path);
+  }
+
+  writer = openFile(path, "a+");
+  if (!isOpen(writer)) return false;
+  readOffset = 0;
+  pendingLength = 0;
+  ready = true;
+  DEBUG_IOTLINK("[IotLink:Journal]: segments %lu..%lu\r\n", readSeq, writeSeq);
+  return true;
+}
+
+void IotLinkJournal::end() {
+  if (!ready) return;
+  closeFile(writer);
+  ready = false;
+}
+
+size_t IotLinkJournal::validLength(unsigned long seq) {
+  char path[48];
+  segmentPath(seq, path);
+  Handle file = openFile(path, "r");
+  if (!isOpen(file)) return 0;
+
+  size_t offset = 0;
+  uint8_t header[recordHeaderSize];
+  uint8_t chunk[64];
+  while (readAt(file, offset, header, recordHeaderSize) == recordHeaderSize && header[0] == 0xa5) {
+    size_t length = header[1] | (header[2] << 8);
+    uint32_t expected = header[3] | (header[4] << 8) | ((uint32_t) header[5] << 16) | ((uint32_t) header[6] << 24);
+    uint32_t crc = 0;
+    size_t done = 0;
+    while (done < length) {
+      size_t n = length - done < sizeof(chunk) ? length - done : sizeof(chunk);
+      if (readAt(file, offset + recordHeaderSize + done, chunk, n) != n) break;
+      crc = crc32(chunk, n, crc);
+      done += n;
+    }
+    if (done < length || crc != expected) break;
+    offset += recordHeaderSize + length;
+  }
+  closeFile(file);
+  return offset;
+}
+
+void IotLinkJournal::writeIndex() {
+  char path[48];
+  indexPath(path);
+  Handle index = openFile(path, "w");
+  if (!isOpen(index)) return;
+  char text[12];
+  int length = snprintf(text, sizeof(text), "%lx", readSeq);
+  writeFlush(index, text, length);
+  closeFile(index);
+}
+
+bool IotLinkJournal::append(char* record, size_t length) {
+  if (!ready || length == 0 || length > 0xffff) return false;
+  if (writeSize && writeSize + recordHeaderSize + length > IOTLINK_JOURNAL_SEGMENT_SIZE && !nextSegment()) return false;
+
+  uint32_t crc = crc32((const uint8_t*) record + recordHeaderSize, length);
+  const uint8_t header[recordHeaderSize] = {
+    0xa5, (uint8_t) length, (uint8_t) (length >> 8),
+    (uint8_t) crc, (uint8_t) (crc >> 8), (uint8_t) (crc >> 16), (uint8_t) (crc >> 24)
+  };
+  memcpy(record, header, recordHeaderSize);
+  if (!writeFlush(writer, record, recordHeaderSize + length)) {
+    DEBUG_IOTLINK("[IotLink:Journal]: write failed, continuing in a new segment\r\n");
+    nextSegment();
+    return false;
+  }
+  writeSize += recordHeaderSize + length;
+  return true;
+}
+
+// closes the segment appended to, whatever follows writeSize in it is never read
+bool IotLinkJournal::nextSegment() {
+  char path[48];
+  closeFile(writer);
+  writeSeq++;
+  writeSize = 0;
+  segmentPath(writeSeq, path);
+  writer = openFile(path, "a+");
+  if (!isOpen(writer)) { ready = false; return false; }
+
+  if (writeSeq - readSeq >= IOTLINK_JOURNAL_SEGMENTS) {
+    DEBUG_IOTLINK("[IotLink:Journal]: full, dropping segment %lu\r\n", readSeq);
+    retireSegment();
+  }
+  return true;
+}
+
+void IotLinkJournal::retireSegment() {
+  char path[48];
+  segmentPath(readSeq, path);
+  removeFile(path);
+  readSeq++;
+  readOffset = 0;
+  pendingLength = 0;
+  writeIndex();
+}
+
+size_t IotLinkJournal::peek(char* buffer, size_t size) {
+  while (!empty()) {
+    char path[48];
+    segmentPath(readSeq, path);
+    Handle file = readSeq == writeSeq ? writer : openFile(path, "r");
+    uint8_t header[recordHeaderSize];
+    size_t length = 0;
+    bool valid = isOpen(file) && readAt(file, readOffset, header, recordHeaderSize) == recordHeaderSize && header[0] == 0xa5;
+    if (valid) {
+      length = header[1] | (header[2] << 8);
+      uint32_t expected = header[3] | (header[4] << 8) | ((uint32_t) header[5] << 16) | ((uint32_t) header[6] << 24);
+      if (length <= size) {
+        valid = readAt(file, readOffset + recordHeaderSize, buffer, length) == length && crc32((const uint8_t*) buffer, length) == expected;
+      }
+    }
+    if (readSeq != writeSeq) closeFile(file);
+
+    if (!valid) {
+      // end of a segment or a damaged record: nothing more to read in this one
+      if (readSeq == writeSeq) { readOffset = writeSize; return 0; }
+      retireSegment();
+      continue;
+    }
+    if (length > size) {
+      DEBUG_IOTLINK("[IotLink:Journal]: skipping record of %u bytes\r\n", (unsigned) length);
+      readOffset += recordHeaderSize + length;
+      continue;
+    }
+    pendingLength = recordHeaderSize + length;
+    return length;
+  }
+  return 0;
+}
+
+void IotLinkJournal::consume() {
+  readOffset += pendingLength;
+  pendingLength = 0;
+  if (readSeq != writeSeq) return;
+  if (readOffset < writeSize) return;
+
+  // everything replayed: start over with an empty segment
+  closeFile(writer);
+  retireSegment();
+  writeSeq = readSeq;
+  writeSize = 0;
+  char path[48];
+  segmentPath(writeSeq, path);
+  writer = openFile(path, "a+");
+  if (!isOpen(writer)) ready = false;
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef _IOTLINKJSONREADER_H_
+#define _IOTLINKJSONREADER_H_
+
+// Piece of the input text, not NUL terminated
+struct IotLinkStringView {
+  const char* data;
+  size_t length;
+
+  IotLinkStringView() : data(nullptr), length(0) {}
+  IotLinkStringView(const char* data, size_t length) : data(data), length(length) {}
+  bool equals(const char* text) const { return data && strncmp(data, text, length) == 0 && text[length] == '\0'; }
+};
+
+// Pull reader walking JSON text in place, nothing is copied or allocated.
+// It only checks as much structure as it needs to find its way through the text;
+// everything handed out points into the input.
+class IotLinkJsonReader {
+  public:
+    IotLinkJsonReader(const char* json, size_t length) : p(json), end(json + length), error(false) {}
+
+    // consume the '{' of an object
+    bool beginObject() { return expect('{'); }
+    // read the key of the next member and its ':', false at the closing '}' (consumed) or on error
+    bool nextMember(IotLinkStringView& key);
+    // skip over any value, raw receives its complete text
+    bool skipValue(IotLinkStringView* raw = nullptr);
+    // read a string without escape sequences (text between the quotes), false for anything else
+    bool readString(IotLinkStringView& text);
+    // read a non negative integer
+    bool readNumber(unsigned long& number);
+    // walk the members of the current object up to key and return the text of its value
+    bool findMember(const char* key, IotLinkStringView& raw);
+
+    bool failed() const { return error; }
+
+  protected:
+    void skipSpace() { while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++; }
+    bool expect(char c);
+    bool skipString(); // p on the opening quote
+    bool fail() { error = true; return false; }
+
+    const char* p;
+    const char* end;
+    bool error;
+};
+
+bool IotLinkJsonReader::expect(char c) {
+  skipSpace();
+  if (p >= end || *p != c) return fail();
+  p++;
+  return true;
+}
+
+bool IotLinkJsonReader::skipString() {
+  for (p++; p < end; p++) {
+    if (*p == '\\') { p++; continue; }
+    if (*p == '"') { p++; return true; }
+  }
+  return fail();
+}
+
+bool IotLinkJsonReader::nextMember(IotLinkStringView& key) {
+  if (error) return false;
+  skipSpace();
+  if (p < end && *p == '}') { p++; return false; }
+  if (p < end && *p == ',') { p++; skipSpace(); }
+  if (p >= end || *p != '"') return fail();
+
+  const char* start = p + 1;
+  if (!skipString()) return false;
+  key = IotLinkStringView(start, p - 1 - start);
+  return expect(':');
+}
+
+bool IotLinkJsonReader::skipValue(IotLinkStringView* raw) {
+  if (error) return false;
+  skipSpace();
+  const char* start = p;
+  if (p >= end) return fail();
+
+  if (*p == '"') {
+    if (!skipString()) return false;
+  } else if (*p == '{' || *p == '[') {
+    int depth = 0;
+    while (p < end) {
+      char c = *p;
+      if (c == '"') { if (!skipString()) return false; continue; }
+      p++;
+      if (c == '{' || c == '[') depth++;
+      else if ((c == '}' || c == ']') && --depth == 0) break;
+    }
+    if (depth) return fail();
+  } else {
+    // number, true, false or null
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
+    if (p == start) return fail();
+  }
+
+  if (raw) *raw = IotLinkStringView(start, p - start);
+  return true;
+}
+
+bool IotLinkJsonReader::readString(IotLinkStringView& text) {
+  if (error) return false;
+  skipSpace();
+  if (p >= end || *p != '"') return fail();
+  const char* start = ++p;
+  while (p < end && *p != '"' && *p != '\\') p++;
+  if (p >= end || *p != '"') return fail();
+  text = IotLinkStringView(start, p++ - start);
+  return true;
+}
+
+bool IotLinkJsonReader::readNumber(unsigned long& number) {
+  if (error) return false;
+  skipSpace();
+  if (p >= end || *p < '0' || *p > '9') return fail();
+  number = 0;
+  while (p < end && *p >= '0' && *p <= '9') number = number * 10 + (*p++ - '0');
+  if (p < end && (*p == '.' || *p == 'e' || *p == 'E')) return fail();
+  return true;
+}
+
+bool IotLinkJsonReader::findMember(const char* key, IotLinkStringView& raw) {
+  IotLinkStringView name;
+  while (nextMember(name)) {
+    if (name.equals(key)) return skipValue(&raw);
+    if (!skipValue()) return false;
+  }
+  return false;
+}
+
+#endif
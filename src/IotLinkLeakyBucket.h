@@ -0,0 +1,65 @@
+#ifndef _IOTLINKLEAKYBUCKET_H_
+#define _IOTLINKLEAKYBUCKET_H_
+
+#include "IotLinkConfig.h"
+#include "IotLinkDebug.h"
+
+// Event rate limit: every event puts a drop into the bucket, one drop leaks out
+// every DROP_OUT_TIME ms and drops need to be at least DROP_IN_TIME ms apart.
+// A full bucket (BUCKET_SIZE drops) blocks events until a drop has leaked.
+class LeakyBucket {
+  public:
+    LeakyBucket() : dropsInBucket(0), lastDrop(0), lastLeak(0), lastWarning(0), warned(false) {}
+    bool addDrop(bool warn = true);
+    // true if addDrop() would succeed now
+    bool canDrop();
+  private:
+    void leak(unsigned long now);
+    int dropsInBucket;
+    unsigned long lastDrop;
+    unsigned long lastLeak;
+    unsigned long lastWarning;
+    bool warned;
+};
+
+void LeakyBucket::leak(unsigned long now) {
+  if (dropsInBucket == 0) { lastLeak = now; return; }
+  unsigned long leaked = (now - lastLeak) / DROP_OUT_TIME;
+  if (leaked == 0) return;
+  if (leaked >= (unsigned long) dropsInBucket) {
+    dropsInBucket = 0;
+    lastLeak = now;
+  } else {
+    dropsInBucket -= leaked;
+    lastLeak += leaked * DROP_OUT_TIME;
+  }
+}
+
+bool LeakyBucket::canDrop() {
+  unsigned long now = millis();
+  leak(now);
+  return dropsInBucket < BUCKET_SIZE && (dropsInBucket == 0 || now - lastDrop >= DROP_IN_TIME);
+}
+
+bool LeakyBucket::addDrop(bool warn) {
+  unsigned long now = millis();
+  leak(now);
+
+  if (dropsInBucket < BUCKET_SIZE && (dropsInBucket == 0 || now - lastDrop >= DROP_IN_TIME)) {
+    dropsInBucket++;
+    lastDrop = now;
+    return true;
+  }
+
+  if (warn && dropsInBucket >= BUCKET_SIZE && now - lastWarning > 1000) {
+    if (!warned) {
+      DEBUG_IOTLINK("[IotLink]: WARNING: too many events in a short period of time! Send events only if the device state has changed.\r\n");
+      warned = true;
+    }
+    DEBUG_IOTLINK("[IotLink]: events are blocked for %lu seconds\r\n", (DROP_OUT_TIME - (now - lastLeak)) / 1000);
+    lastWarning = now;
+  }
+  return false;
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef _IOTLINKMESSAGEPOOL_H_
+#define _IOTLINKMESSAGEPOOL_H_
+
+#include <utility>
+#include <ArduinoJson.h>
+#include "IotLinkConfig.h"
+#include "IotLinkDebug.h"
+
+class IotLinkMessagePool;
+
+// Handle of a borrowed JsonDocument. The document is cleared and handed back to
+// its pool when the handle goes out of scope. Handles can be moved, not copied.
+class IotLinkMessage {
+  public:
+    IotLinkMessage() : _doc(nullptr), _pool(nullptr), _owned(nullptr) {}
+    IotLinkMessage(JsonDocument* doc, IotLinkMessagePool* pool) : _doc(doc), _pool(pool), _owned(nullptr) {}
+    explicit IotLinkMessage(DynamicJsonDocument* owned) : _doc(owned), _pool(nullptr), _owned(owned) {}
+    IotLinkMessage(IotLinkMessage&& other) : _doc(other._doc), _pool(other._pool), _owned(other._owned) { other._doc = nullptr; other._owned = nullptr; }
+    IotLinkMessage& operator=(IotLinkMessage&& other);
+    IotLinkMessage(const IotLinkMessage&) = delete;
+    IotLinkMessage& operator=(const IotLinkMessage&) = delete;
+    ~IotLinkMessage() { release(); }
+
+    JsonDocument& operator*() { return *_doc; }
+    JsonDocument* operator->() { return _doc; }
+    operator JsonDocument&() { return *_doc; }
+    template <typename TKey>
+    auto operator[](TKey key) -> decltype(std::declval<JsonDocument&>()[key]) { return (*_doc)[key]; }
+
+  private:
+    void release();
+    JsonDocument* _doc;
+    IotLinkMessagePool* _pool;
+    DynamicJsonDocument* _owned; // set if the pool was exhausted and the document lives on the heap
+};
+
+// Fixed set of preallocated documents for building and parsing messages, so
+// steady state messaging does not touch the heap.
+class IotLinkMessagePool {
+  public:
+    IotLinkMessagePool() : inUse(0) {}
+    IotLinkMessage borrow();
+  private:
+    friend class IotLinkMessage;
+    void giveBack(JsonDocument* doc);
+
+    StaticJsonDocument<IOTLINK_MESSAGE_CAPACITY> docs[IOTLINK_MESSAGE_POOL_SIZE];
+    uint32_t inUse;
+};
+
+static_assert(IOTLINK_MESSAGE_POOL_SIZE <= 32, "IOTLINK_MESSAGE_POOL_SIZE must fit the 32 bit inUse mask");
+
+IotLinkMessage& IotLinkMessage::operator=(IotLinkMessage&& other) {
+  if (this != &other) {
+    release();
+    _doc = other._doc;
+    _pool = other._pool;
+    _owned = other._owned;
+    other._doc = nullptr;
+    other._owned = nullptr;
+  }
+  return *this;
+}
+
+void IotLinkMessage::release() {
+  if (_owned) delete _owned;
+  else if (_doc && _pool) _pool->giveBack(_doc);
+  _doc = nullptr;
+  _owned = nullptr;
+}
+
+IotLinkMessage IotLinkMessagePool::borrow() {
+  for (uint8_t i = 0; i < IOTLINK_MESSAGE_POOL_SIZE; i++) {
+    if (inUse & (1UL << i)) continue;
+    inUse |= (1UL << i);
+    return IotLinkMessage(&docs[i], this);
+  }
+  DEBUG_IOTLINK("[IotLink:MessagePool]: all %d documents in use, allocating a temporary one\r\n", IOTLINK_MESSAGE_POOL_SIZE);
+  return IotLinkMessage(new DynamicJsonDocument(IOTLINK_MESSAGE_CAPACITY));
+}
+
+void IotLinkMessagePool::giveBack(JsonDocument* doc) {
+  for (uint8_t i = 0; i < IOTLINK_MESSAGE_POOL_SIZE; i++) {
+    if (doc != &docs[i]) continue;
+    docs[i].clear();
+    inUse &= ~(1UL << i);
+    return;
+  }
+}
+
+#endif
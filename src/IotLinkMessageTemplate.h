@@ -0,0 +1,228 @@
+#ifndef _IOTLINKMESSAGETEMPLATE_H_
+#define _IOTLINKMESSAGETEMPLATE_H_
+
+#include <ArduinoJson.h>
+
+// constant framing around the payload of every outgoing message
+#define IOTLINK_MESSAGE_HEADER "{\"header\":{\"payloadVersion\":2,\"signatureVersion\":1},\"payload\":"
+#define IOTLINK_MESSAGE_SIGNATURE ",\"signature\":{\"HMAC\":\""
+#define IOTLINK_MESSAGE_TRAILER "\"}}"
+
+// payload of a batch message: {"type":"batch","events":[<event payload>,...],"createdAt":..}
+#define IOTLINK_BATCH_HEADER "{\"type\":\"batch\",\"events\":["
+#define IOTLINK_BATCH_TRAILER "],\"createdAt\":"
+
+// bounded writer used while rendering. It stops writing and remembers once buf is
+// full; with buf == nullptr it only counts.
+class IotLinkTextWriter {
+  public:
+    IotLinkTextWriter(char* buf, size_t size) : buf(buf), size(size), pos(0), overflow(false) {}
+    void put(const char* text, size_t len);
+    void put(const char* text) { put(text, strlen(text)); }
+    void putEscaped(const char* text);
+    void putNumber(unsigned long value);
+    void putSigned(long value);
+    // value rounded to decimals (at most 9) digits, without trailing zeros and without
+    // printf; very large values get an exponent, NaN and infinity become null like in ArduinoJson
+    void putDecimal(float value, uint8_t decimals);
+    void putDecimal(double value, uint8_t decimals);
+    size_t length() const { return overflow ? 0 : pos; }
+    char* end() const { return buf + pos; }
+    size_t available() const { return overflow ? 0 : size - pos; }
+    void skip(size_t len) { if (len > available()) overflow = true; else pos += len; }
+  private:
+    template <typename T> void putScaled(T value, uint8_t decimals);
+
+    char* buf;
+    size_t size;
+    size_t pos;
+    bool overflow;
+};
+
+// Pre-rendered text of an event payload for one device and action.
+//
+// The constant parts (action, deviceId, type and all keys) are rendered once by
+// begin(). render() only writes the variable fields (cause, createdAt,
+// replyToken and value) between them, producing the same text ArduinoJson
+// serializes from the document built by IotLinkClass::prepareEvent():
+//
+//   {"action":"..","cause":{"type":".."},"createdAt":..,"deviceId":"..","replyToken":"..","type":"event","value":..}
+class IotLinkEventTemplate {
+  public:
+    IotLinkEventTemplate() : head(nullptr), headLen(0), device(nullptr), deviceLen(0) {}
+    ~IotLinkEventTemplate() { free(head); free(device); }
+    IotLinkEventTemplate(const IotLinkEventTemplate&) = delete;
+    IotLinkEventTemplate& operator=(const IotLinkEventTemplate&) = delete;
+
+    bool begin(const char* deviceId, const char* action);
+    bool isReady() const { return head && device; }
+    bool isAction(const char* action) const;
+
+    // render the payload into buf, returns its length or 0 if it does not fit into size bytes
+    size_t render(char* buf, size_t size, const char* cause, unsigned long createdAt, const char* replyToken, const char* value) const;
+    size_t render(char* buf, size_t size, const char* cause, unsigned long createdAt, const char* replyToken, JsonObject value) const;
+    // same for a value that writes itself with value.write(IotLinkTextWriter&), like IotLinkRecord
+    template <typename Value>
+    size_t renderValue(char* buf, size_t size, const char* cause, unsigned long createdAt, const char* replyToken, const Value& value) const;
+
+  private:
+    void renderFields(IotLinkTextWriter& out, const char* cause, unsigned long createdAt, const char* replyToken) const;
+    static char* renderQuoted(const char* prefix, const char* text, const char* suffix, size_t& len);
+
+    char* head;      // {"action":"..","cause":{"type":"
+    size_t headLen;
+    char* device;    // ,"deviceId":"..","replyToken":"
+    size_t deviceLen;
+};
+
+void IotLinkTextWriter::put(const char* text, size_t len) {
+  if (overflow || len > size - pos) { overflow = true; return; }
+  if (buf) memcpy(buf + pos, text, len);
+  pos += len;
+}
+
+// same escaping as ArduinoJson's serializer
+void IotLinkTextWriter::putEscaped(const char* text) {
+  const char* run = text;
+  for (const char* p = text; *p; p++) {
+    char e;
+    switch (*p) {
+      case '"':  e = '"'; break;
+      case '\\': e = '\\'; break;
+      case '\b': e = 'b'; break;
+      case '\f': e = 'f'; break;
+      case '\n': e = 'n'; break;
+      case '\r': e = 'r'; break;
+      case '\t': e = 't'; break;
+      default: continue;
+    }
+    put(run, p - run);
+    char escape[2] = { '\\', e };
+    put(escape, 2);
+    run = p + 1;
+  }
+  put(run);
+}
+
+void IotLinkTextWriter::putNumber(unsigned long value) {
+  char digits[20];
+  char* p = digits + sizeof(digits);
+  do { *--p = '0' + (value % 10); value /= 10; } while (value);
+  put(p, digits + sizeof(digits) - p);
+}
+
+void IotLinkTextWriter::putSigned(long value) {
+  if (value < 0) {
+    put("-", 1);
+    putNumber(0UL - (unsigned long) value);
+  } else {
+    putNumber((unsigned long) value);
+  }
+}
+
+void IotLinkTextWriter::putDecimal(float value, uint8_t decimals) { putScaled(value, decimals); }
+
+void IotLinkTextWriter::putDecimal(double value, uint8_t decimals) { putScaled(value, decimals); }
+
+template <typename T>
+void IotLinkTextWriter::putScaled(T value, uint8_t decimals) {
+  static const uint32_t powers[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+  if (value != value || value - value != 0) { put("null", 4); return; } // NaN, infinity
+  bool negative = value < 0;
+  if (negative) value = -value;
+  if (decimals > 9) decimals = 9;
+
+  // too large for 32 bits: keep 9 significant digits and an exponent
+  int exponent = 0;
+  while (value * powers[decimals] >= (T) 4294967040.0) {
+    if (decimals) { decimals--; continue; }
+    value /= 10;
+    exponent++;
+  }
+
+  uint32_t scaled = (uint32_t) (value * powers[decimals] + (T) 0.5);
+  while (decimals && scaled % 10 == 0) { scaled /= 10; decimals--; }
+  while (exponent && scaled && scaled % 10 == 0) { scaled /= 10; exponent++; }
+  if (negative && scaled) put("-", 1);
+  putNumber(scaled / powers[decimals]);
+  if (decimals) {
+    char fraction[10];
+    uint32_t rest = scaled % powers[decimals];
+    for (int i = decimals - 1; i >= 0; i--) { fraction[i] = '0' + rest % 10; rest /= 10; }
+    put(".", 1);
+    put(fraction, decimals);
+  }
+  if (exponent) {
+    put("e", 1);
+    putNumber((unsigned long) exponent);
+  }
+}
+
+char* IotLinkEventTemplate::renderQuoted(const char* prefix, const char* text, const char* suffix, size_t& len) {
+  IotLinkTextWriter measure(nullptr, (size_t) -1);
+  measure.put(prefix); measure.putEscaped(text); measure.put(suffix);
+  len = measure.length();
+
+  char* buf = (char*) malloc(len);
+  if (!buf) return nullptr;
+  IotLinkTextWriter out(buf, len);
+  out.put(prefix); out.putEscaped(text); out.put(suffix);
+  return buf;
+}
+
+bool IotLinkEventTemplate::begin(const char* deviceId, const char* action) {
+  free(head); free(device);
+  head = renderQuoted("{\"action\":\"", action, "\",\"cause\":{\"type\":\"", headLen);
+  device = renderQuoted(",\"deviceId\":\"", deviceId, "\",\"replyToken\":\"", deviceLen);
+  return isReady();
+}
+
+bool IotLinkEventTemplate::isAction(const char* action) const {
+  if (!head) return false;
+  const size_t prefixLen = 11; // {"action":"
+  size_t len = strlen(action);
+  return headLen > prefixLen + len && strncmp(head + prefixLen, action, len) == 0 && head[prefixLen + len] == '"';
+}
+
+void IotLinkEventTemplate::renderFields(IotLinkTextWriter& out, const char* cause, unsigned long createdAt, const char* replyToken) const {
+  out.put(head, headLen);
+  out.putEscaped(cause);
+  out.put("\"},\"createdAt\":");
+  out.putNumber(createdAt);
+  out.put(device, deviceLen);
+  out.putEscaped(replyToken);
+  out.put("\",\"type\":\"event\",\"value\":");
+}
+
+size_t IotLinkEventTemplate::render(char* buf, size_t size, const char* cause, unsigned long createdAt, const char* replyToken, const char* value) const {
+  if (!isReady()) return 0;
+  IotLinkTextWriter out(buf, size);
+  renderFields(out, cause, createdAt, replyToken);
+  out.put(value);
+  out.put("}", 1);
+  return out.length();
+}
+
+size_t IotLinkEventTemplate::render(char* buf, size_t size, const char* cause, unsigned long createdAt, const char* replyToken, JsonObject value) const {
+  if (!isReady()) return 0;
+  IotLinkTextWriter out(buf, size);
+  renderFields(out, cause, createdAt, replyToken);
+  size_t valueLen = measureJson(value);
+  if (valueLen + 1 > out.available()) return 0; // serializeJson() also writes a NUL
+  serializeJson(value, out.end(), valueLen + 1);
+  out.skip(valueLen);
+  out.put("}", 1);
+  return out.length();
+}
+
+template <typename Value>
+size_t IotLinkEventTemplate::renderValue(char* buf, size_t size, const char* cause, unsigned long createdAt, const char* replyToken, const Value& value) const {
+  if (!isReady()) return 0;
+  IotLinkTextWriter out(buf, size);
+  renderFields(out, cause, createdAt, replyToken);
+  value.write(out);
+  out.put("}", 1);
+  return out.length();
+}
+
+#endif
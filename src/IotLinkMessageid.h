@@ -1,27 +1,78 @@
 #ifndef __MESSAGEID_H__
 #define __MESSAGEID_H__
 
+#include "extralib/Crypto/RNG.h"
+
+#define MESSAGEID_LENGTH 36
+
+// number of pre-generated reply tokens kept by MessageIDPool, 0 generates every token on demand
+#ifndef MESSAGEID_POOL_SIZE
+#define MESSAGEID_POOL_SIZE 4
+#endif
+
 class MessageID {
 public:
   MessageID();
   const String& getID() { return _id; }
+
+  // writes a random UUIDv4 and a terminating NUL into id, no allocation
+  static void generate(char id[MESSAGEID_LENGTH + 1]);
 private:
   String _id;
 };
 
 MessageID::MessageID() {
-  _id = "";
+  char id[MESSAGEID_LENGTH + 1];
+  generate(id);
+  _id = id;
+}
+
+void MessageID::generate(char id[MESSAGEID_LENGTH + 1]) {
+  static const char hex[] = "0123456789abcdef";
+  byte bytes[16];
+  RNG::fill(bytes, sizeof(bytes));
+  bytes[6] = 0x40 | (0x0F & bytes[6]); // 0100xxxx to set version 4
+  bytes[8] = 0x80 | (0x3F & bytes[8]); // 10xxxxxx to set reserved bits
+
+  char* p = id;
   for (byte i=0; i<16; i++) {
-    byte rnd = random(255);
-    if (i==4) _id += "-";
-    if (i==6) { _id += "-"; rnd = 0x40 | (0x0F & rnd); } // 0100xxxx to set version 4
-    if (i==8) { _id += "-"; rnd = 0x80 | (0x3F & rnd); } // 10xxxxxx to set reserved bits
-    if (i==10) _id += "-";
-    byte high_nibble = rnd >> 4;
-    byte low_nibble = rnd & 0x0f;
-    _id += "0123456789abcdef"[high_nibble];
-    _id += "0123456789abcdef"[low_nibble];
+    if (i==4 || i==6 || i==8 || i==10) *p++ = '-';
+    *p++ = hex[bytes[i] >> 4];
+    *p++ = hex[bytes[i] & 0x0f];
+  }
+  *p = '\0';
+}
+
+// Ring of ready-made reply tokens. next() hands out the oldest one, refill() tops
+// the ring up again and is meant to run from idle time (IotLinkClass::handle()).
+// A token stays valid until the next refill() or MESSAGEID_POOL_SIZE further next() calls.
+class MessageIDPool {
+public:
+  MessageIDPool() : _next(0), _count(0) {}
+  const char* next();
+  void refill();
+private:
+  char _ids[MESSAGEID_POOL_SIZE > 0 ? MESSAGEID_POOL_SIZE : 1][MESSAGEID_LENGTH + 1];
+  uint8_t _next;
+  uint8_t _count;
+};
+
+const char* MessageIDPool::next() {
+  const uint8_t size = MESSAGEID_POOL_SIZE > 0 ? MESSAGEID_POOL_SIZE : 1;
+  if (_count == 0) MessageID::generate(_ids[_next]); // pool ran dry, generate in place
+  else _count--;
+  const char* id = _ids[_next];
+  _next = (_next + 1) % size;
+  return id;
+}
+
+void MessageIDPool::refill() {
+#if MESSAGEID_POOL_SIZE > 0
+  while (_count < MESSAGEID_POOL_SIZE) {
+    MessageID::generate(_ids[(_next + _count) % MESSAGEID_POOL_SIZE]);
+    _count++;
   }
+#endif
 }
 
 #endif
@@ -0,0 +1,128 @@
+#ifndef _IOTLINKMSGPACKREADER_H_
+#define _IOTLINKMSGPACKREADER_H_
+
+#include "IotLinkJsonReader.h"
+
+// Counterpart of IotLinkJsonReader for MessagePack frames: walks the encoded
+// bytes in place to hand out the exact bytes of a member, which is what the
+// signature of a binary message is computed over.
+class IotLinkMsgPackReader {
+  public:
+    IotLinkMsgPackReader(const uint8_t* data, size_t length) : p(data), end(data + length), members(0), error(false) {}
+
+    // read a map header
+    bool beginObject();
+    // read the next key of the current map, false after the last one or on error
+    bool nextMember(IotLinkStringView& key);
+    // skip over any value, raw receives its complete encoding
+    bool skipValue(IotLinkStringView* raw = nullptr);
+    // walk the members of the current map up to key and return the encoding of its value
+    bool findMember(const char* key, IotLinkStringView& raw);
+
+    bool failed() const { return error; }
+
+  private:
+    // size of the header at p and of the data following it, the number of nested values in children
+    bool readHeader(size_t& header, size_t& data, size_t& children);
+    size_t readLength(size_t offset, size_t bytes) const;
+    bool fail() { error = true; return false; }
+
+    const uint8_t* p;
+    const uint8_t* end;
+    size_t members;
+    bool error;
+};
+
+size_t IotLinkMsgPackReader::readLength(size_t offset, size_t bytes) const {
+  size_t value = 0;
+  for (size_t i = 0; i < bytes; i++) value = (value << 8) | p[offset + i];
+  return value;
+}
+
+bool IotLinkMsgPackReader::readHeader(size_t& header, size_t& data, size_t& children) {
+  if (p >= end) return fail();
+  uint8_t type = *p;
+  header = 1; data = 0; children = 0;
+
+  if (type <= 0x7f || type >= 0xe0) return true;                     // fixint
+  if (type <= 0x8f) { children = 2 * (type & 0x0f); return true; }   // fixmap
+  if (type <= 0x9f) { children = type & 0x0f; return true; }         // fixarray
+  if (type <= 0xbf) { data = type & 0x1f; return true; }             // fixstr
+
+  size_t lengthBytes = 0;
+  switch (type) {
+    case 0xc0: case 0xc2: case 0xc3: return true;                    // nil, false, true
+    case 0xcc: case 0xd0: data = 1; return true;
+    case 0xcd: case 0xd1: data = 2; return true;
+    case 0xca: case 0xce: case 0xd2: data = 4; return true;
+    case 0xcb: case 0xcf: case 0xd3: data = 8; return true;
+    case 0xd4: data = 2; return true;                                // fixext, type byte included
+    case 0xd5: data = 3; return true;
+    case 0xd6: data = 5; return true;
+    case 0xd7: data = 9; return true;
+    case 0xd8: data = 17; return true;
+    case 0xc4: case 0xd9: lengthBytes = 1; break;                    // bin8, str8
+    case 0xc5: case 0xda: lengthBytes = 2; break;
+    case 0xc6: case 0xdb: lengthBytes = 4; break;
+    case 0xc7: lengthBytes = 1; data = 1; break;                     // ext, plus the type byte
+    case 0xc8: lengthBytes = 2; data = 1; break;
+    case 0xc9: lengthBytes = 4; data = 1; break;
+    case 0xdc: case 0xde: lengthBytes = 2; break;                    // array16, map16
+    case 0xdd: case 0xdf: lengthBytes = 4; break;
+    default: return fail();                                          // 0xc1 is never used
+  }
+  if ((size_t) (end - p) < 1 + lengthBytes) return fail();
+  header += lengthBytes;
+  size_t length = readLength(1, lengthBytes);
+  if (type == 0xdc || type == 0xdd) children = length;
+  else if (type == 0xde || type == 0xdf) children = 2 * length;
+  else data += length;
+  return true;
+}
+
+bool IotLinkMsgPackReader::beginObject() {
+  size_t header, data, children;
+  if (error || !readHeader(header, data, children)) return false;
+  if (!(*p >= 0x80 && *p <= 0x8f) && *p != 0xde && *p != 0xdf) return fail();
+  p += header;
+  members = children / 2;
+  return true;
+}
+
+bool IotLinkMsgPackReader::nextMember(IotLinkStringView& key) {
+  if (error || members == 0) return false;
+  members--;
+  size_t header, data, children;
+  if (!readHeader(header, data, children)) return false;
+  bool isString = (*p >= 0xa0 && *p <= 0xbf) || *p == 0xd9 || *p == 0xda || *p == 0xdb;
+  if (!isString || (size_t) (end - p) < header + data) return fail();
+  key = IotLinkStringView((const char*) p + header, data);
+  p += header + data;
+  return true;
+}
+
+bool IotLinkMsgPackReader::skipValue(IotLinkStringView* raw) {
+  if (error) return false;
+  const uint8_t* start = p;
+  size_t pending = 1;
+  while (pending) {
+    size_t header, data, children;
+    if (!readHeader(header, data, children)) return false;
+    if ((size_t) (end - p) < header + data) return fail();
+    p += header + data;
+    pending += children - 1;
+  }
+  if (raw) *raw = IotLinkStringView((const char*) start, p - start);
+  return true;
+}
+
+bool IotLinkMsgPackReader::findMember(const char* key, IotLinkStringView& raw) {
+  IotLinkStringView name;
+  while (nextMember(name)) {
+    if (name.equals(key)) return skipValue(&raw);
+    if (!skipValue()) return false;
+  }
+  return false;
+}
+
+#endif
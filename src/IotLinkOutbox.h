@@ -0,0 +1,99 @@
+#ifndef _IOTLINKOUTBOX_H_
+#define _IOTLINKOUTBOX_H_
+
+#include "IotLinkConfig.h"
+
+// Outgoing payloads waiting to be sent. Records of a two byte length and the
+// payload text are stored back to back in a ring over storage preallocated by
+// the owner, so a burst of queued messages never touches the heap.
+class IotLinkOutbox {
+  public:
+    enum Overflow {
+      DropOldest, // a new payload pushes out the oldest ones until it fits
+      DropNewest  // a new payload is dropped when it does not fit
+    };
+
+    IotLinkOutbox() : storage(nullptr), capacity(0), head(0), used(0), count(0), dropped(0), overflow(DropOldest) {}
+
+    void begin(char* storage, size_t capacity) { this->storage = storage; this->capacity = capacity; }
+    void setOverflow(Overflow policy) { overflow = policy; }
+    bool push(const char* payload, size_t length);
+    // length of the oldest payload, 0 if empty
+    size_t front() const;
+    // copy the oldest payload to buffer (front() bytes) and remove it
+    void shift(char* buffer);
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    // payloads lost to overflow since the last call
+    size_t takeDropped() { size_t result = dropped; dropped = 0; return result; }
+
+  private:
+    void read(size_t pos, char* out, size_t length) const;
+    void write(size_t pos, const char* in, size_t length);
+    void drop();
+
+    char* storage;
+    size_t capacity;
+    size_t head;  // start of the oldest record
+    size_t used;
+    size_t count;
+    size_t dropped;
+    Overflow overflow;
+};
+
+void IotLinkOutbox::read(size_t pos, char* out, size_t length) const {
+  pos %= capacity;
+  size_t first = capacity - pos;
+  if (first > length) first = length;
+  memcpy(out, storage + pos, first);
+  memcpy(out + first, storage, length - first);
+}
+
+void IotLinkOutbox::write(size_t pos, const char* in, size_t length) {
+  pos %= capacity;
+  size_t first = capacity - pos;
+  if (first > length) first = length;
+  memcpy(storage + pos, in, first);
+  memcpy(storage, in + first, length - first);
+}
+
+bool IotLinkOutbox::push(const char* payload, size_t length) {
+  if (length == 0 || length + 2 > capacity) { dropped++; return false; }
+  while (capacity - used < length + 2) {
+    if (overflow == DropNewest) { dropped++; return false; }
+    drop();
+  }
+  char prefix[2] = { (char) (length & 0xff), (char) (length >> 8) };
+  write(head + used, prefix, 2);
+  write(head + used + 2, payload, length);
+  used += length + 2;
+  count++;
+  return true;
+}
+
+size_t IotLinkOutbox::front() const {
+  if (!count) return 0;
+  char prefix[2];
+  read(head, prefix, 2);
+  return (uint8_t) prefix[0] | ((uint8_t) prefix[1] << 8);
+}
+
+void IotLinkOutbox::shift(char* buffer) {
+  size_t length = front();
+  if (!length) return;
+  read(head + 2, buffer, length);
+  head = (head + length + 2) % capacity;
+  used -= length + 2;
+  count--;
+}
+
+void IotLinkOutbox::drop() {
+  size_t length = front();
+  head = (head + length + 2) % capacity;
+  used -= length + 2;
+  count--;
+  dropped++;
+}
+
+#endif
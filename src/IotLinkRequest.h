@@ -0,0 +1,53 @@
+#ifndef _IOTLINKREQUEST_H_
+#define _IOTLINKREQUEST_H_
+
+#include "IotLinkJsonReader.h"
+
+// Fields of a request payload as views into the received text, for handling
+// requests without a JsonDocument. parse() only accepts payloads it can represent
+// this way (plain strings, integer createdAt, object value); anything else is left
+// to the JsonDocument path.
+struct IotLinkFastRequest {
+  IotLinkStringView type;
+  IotLinkStringView action;
+  IotLinkStringView deviceId;
+  IotLinkStringView replyToken;
+  IotLinkStringView clientId;
+  IotLinkStringView value;   // complete text of the value object
+  unsigned long createdAt = 0;
+
+  bool parse(const IotLinkStringView& payload);
+
+  // plain string member of value
+  bool getString(const char* key, IotLinkStringView& text) const;
+};
+
+bool IotLinkFastRequest::parse(const IotLinkStringView& payload) {
+  IotLinkJsonReader reader(payload.data, payload.length);
+  if (!reader.beginObject()) return false;
+
+  IotLinkStringView key;
+  while (reader.nextMember(key)) {
+    bool ok;
+    if (key.equals("type")) ok = reader.readString(type);
+    else if (key.equals("action")) ok = reader.readString(action);
+    else if (key.equals("deviceId")) ok = reader.readString(deviceId);
+    else if (key.equals("replyToken")) ok = reader.readString(replyToken);
+    else if (key.equals("clientId")) ok = reader.readString(clientId);
+    else if (key.equals("createdAt")) ok = reader.readNumber(createdAt);
+    else if (key.equals("value")) ok = reader.skipValue(&value) && value.data[0] == '{';
+    else ok = reader.skipValue();
+    if (!ok) return false;
+  }
+  return !reader.failed() && type.data && action.data && deviceId.data && value.data;
+}
+
+bool IotLinkFastRequest::getString(const char* key, IotLinkStringView& text) const {
+  IotLinkJsonReader reader(value.data, value.length);
+  IotLinkStringView raw;
+  if (!reader.beginObject() || !reader.findMember(key, raw)) return false;
+  IotLinkJsonReader member(raw.data, raw.length);
+  return member.readString(text);
+}
+
+#endif
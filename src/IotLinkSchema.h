@@ -0,0 +1,191 @@
+#ifndef _IOTLINKSCHEMA_H_
+#define _IOTLINKSCHEMA_H_
+
+#include <stddef.h>
+#include "IotLinkConfig.h"
+#include "IotLinkMessageTemplate.h"
+
+// Typed sensor values: a plain struct plus a schema of field descriptors that is
+// built at compile time and kept in flash, names included. IotLinkRecord writes the
+// fields of an instance straight into an outgoing message, numbers are formatted by
+// IotLinkTextWriter without printf. Declare the schema at global scope:
+//
+//   struct Climate { float temperature; float humidity; bool lowBattery; };
+//   IOTLINK_SCHEMA(Climate,
+//     IOTLINK_FIELD(Climate, temperature, 1),    // one decimal
+//     IOTLINK_FIELD(Climate, humidity, 0),
+//     IOTLINK_FIELD(Climate, lowBattery, 0));
+//
+//   Climate reading = { 21.54, 40.2, false };
+//   sensor.sendSensorValues(reading, "temperature");  // {"temperature":21.5,"humidity":40,"lowBattery":false}
+//
+// Supported member types are bool, the integer types up to 32 bits, float, double,
+// const char* and String; any other type does not compile.
+struct IotLinkField {
+  enum Type : uint8_t { Bool, Signed, Unsigned, Float, Double, Text, StringText };
+
+  char name[IOTLINK_FIELD_NAME_SIZE];
+  uint8_t type;
+  uint8_t size;        // bytes of an integer member
+  uint8_t precision;   // decimals of a float or double member
+  uint16_t offset;
+
+  static constexpr uint8_t typeOf(const bool*) { return Bool; }
+  static constexpr uint8_t typeOf(const signed char*) { return Signed; }
+  static constexpr uint8_t typeOf(const short*) { return Signed; }
+  static constexpr uint8_t typeOf(const int*) { return Signed; }
+  static constexpr uint8_t typeOf(const long*) { return Signed; }
+  static constexpr uint8_t typeOf(const unsigned char*) { return Unsigned; }
+  static constexpr uint8_t typeOf(const unsigned short*) { return Unsigned; }
+  static constexpr uint8_t typeOf(const unsigned int*) { return Unsigned; }
+  static constexpr uint8_t typeOf(const unsigned long*) { return Unsigned; }
+  static constexpr uint8_t typeOf(const float*) { return Float; }
+  static constexpr uint8_t typeOf(const double*) { return Double; }
+  static constexpr uint8_t typeOf(const char* const*) { return Text; }
+  static constexpr uint8_t typeOf(const String*) { return StringText; }
+};
+
+#define IOTLINK_FIELD(Type, member, precision) \
+  { #member, IotLinkField::typeOf((decltype(Type::member)*) nullptr), sizeof(Type::member), precision, offsetof(Type, member) }
+
+// specialized by IOTLINK_SCHEMA, fields() returns the descriptors in flash
+template <typename T> struct IotLinkSchema;
+
+#define IOTLINK_SCHEMA(Type, ...) \
+  template <> struct IotLinkSchema<Type> { \
+    static const IotLinkField* fields(size_t& count) { \
+      static const IotLinkField list[] PROGMEM = { __VA_ARGS__ }; \
+      count = sizeof(list) / sizeof(list[0]); \
+      return list; \
+    } \
+  }
+
+// an instance together with its schema
+class IotLinkRecord {
+  public:
+    IotLinkRecord(const IotLinkField* fields, size_t count, const void* data) : fields(fields), count(count), data((const uint8_t*) data) {}
+    template <typename T>
+    static IotLinkRecord of(const T& value) { size_t count; const IotLinkField* fields = IotLinkSchema<T>::fields(count); return IotLinkRecord(fields, count, &value); }
+
+    // writes {"<name>":<value>,...}
+    void write(IotLinkTextWriter& out) const;
+    size_t measure() const;
+    String toString() const;
+    // value of a numeric field, false if there is no such field
+    bool getNumber(const char* name, float& value) const;
+
+  private:
+    void descriptor(size_t index, IotLinkField& field) const { memcpy_P(&field, fields + index, sizeof(field)); }
+    void writeValue(IotLinkTextWriter& out, const IotLinkField& field) const;
+    long readSigned(const IotLinkField& field) const;
+    unsigned long readUnsigned(const IotLinkField& field) const;
+
+    const IotLinkField* fields;
+    size_t count;
+    const uint8_t* data;
+};
+
+long IotLinkRecord::readSigned(const IotLinkField& field) const {
+  const uint8_t* p = data + field.offset;
+  switch (field.size) {
+    case 1: { int8_t v; memcpy(&v, p, 1); return v; }
+    case 2: { int16_t v; memcpy(&v, p, 2); return v; }
+    case 4: { int32_t v; memcpy(&v, p, 4); return v; }
+  }
+  long v; memcpy(&v, p, sizeof(v)); return v;
+}
+
+unsigned long IotLinkRecord::readUnsigned(const IotLinkField& field) const {
+  const uint8_t* p = data + field.offset;
+  switch (field.size) {
+    case 1: return *p;
+    case 2: { uint16_t v; memcpy(&v, p, 2); return v; }
+    case 4: { uint32_t v; memcpy(&v, p, 4); return v; }
+  }
+  unsigned long v; memcpy(&v, p, sizeof(v)); return v;
+}
+
+void IotLinkRecord::writeValue(IotLinkTextWriter& out, const IotLinkField& field) const {
+  const uint8_t* p = data + field.offset;
+  switch (field.type) {
+    case IotLinkField::Bool:
+      if (*p) out.put("true", 4); else out.put("false", 5);
+      break;
+    case IotLinkField::Signed:
+      out.putSigned(readSigned(field));
+      break;
+    case IotLinkField::Unsigned:
+      out.putNumber(readUnsigned(field));
+      break;
+    case IotLinkField::Float: {
+      float v; memcpy(&v, p, sizeof(v));
+      out.putDecimal(v, field.precision);
+      break;
+    }
+    case IotLinkField::Double: {
+      double v; memcpy(&v, p, sizeof(v));
+      out.putDecimal(v, field.precision);
+      break;
+    }
+    case IotLinkField::Text: {
+      const char* text; memcpy(&text, p, sizeof(text));
+      if (!text) { out.put("null", 4); break; }
+      out.put("\"", 1); out.putEscaped(text); out.put("\"", 1);
+      break;
+    }
+    case IotLinkField::StringText:
+      out.put("\"", 1); out.putEscaped(((const String*) p)->c_str()); out.put("\"", 1);
+      break;
+  }
+}
+
+void IotLinkRecord::write(IotLinkTextWriter& out) const {
+  out.put("{", 1);
+  for (size_t i = 0; i < count; i++) {
+    IotLinkField current;
+    descriptor(i, current);
+    out.put(i ? ",\"" : "\"", i ? 2 : 1);
+    out.put(current.name);  // member names never need escaping
+    out.put("\":", 2);
+    writeValue(out, current);
+  }
+  out.put("}", 1);
+}
+
+size_t IotLinkRecord::measure() const {
+  IotLinkTextWriter measure(nullptr, (size_t) -1);
+  write(measure);
+  return measure.length();
+}
+
+// text of the record for the paths that keep it around (held events, JsonDocument fallback)
+String IotLinkRecord::toString() const {
+  size_t length = measure();
+  char* text = (char*) malloc(length + 1);
+  if (!text) return String();
+  IotLinkTextWriter out(text, length);
+  write(out);
+  text[length] = '\0';
+  String result(text);
+  free(text);
+  return result;
+}
+
+bool IotLinkRecord::getNumber(const char* name, float& value) const {
+  for (size_t i = 0; i < count; i++) {
+    IotLinkField current;
+    descriptor(i, current);
+    if (strcmp(current.name, name) != 0) continue;
+    const uint8_t* p = data + current.offset;
+    switch (current.type) {
+      case IotLinkField::Signed: value = readSigned(current); return true;
+      case IotLinkField::Unsigned: value = readUnsigned(current); return true;
+      case IotLinkField::Float: memcpy(&value, p, sizeof(value)); return true;
+      case IotLinkField::Double: { double v; memcpy(&v, p, sizeof(v)); value = v; return true; }
+      default: return false;
+    }
+  }
+  return false;
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef _IOTLINKSERIES_H_
+#define _IOTLINKSERIES_H_
+
+#include <Arduino.h>
+#include "extralib/Crypto/Base64.h"
+
+// One reading of a series: millis() when it was taken and the value in fixed point
+struct IotLinkSample {
+  uint32_t time;
+  int32_t value;
+};
+
+// Readings of one numeric field collected for IotLinkControl::sendSensorSeries(),
+// kept in storage owned by the caller.
+//
+// Encoded (format 1) column by column, every number a LEB128 varint:
+//   [1][precision][count][age]  age: ms from the first reading to the encoding
+//   count - 1 delta-of-delta times (ms), the first delta counts from 0
+//   first value, then count - 1 value deltas (value * 10^precision)
+// Each column entry is written as zigzag(x) << 1, a run of n zeros as n << 1 | 1.
+// Regular sampling turns the time column into a single run and slowly changing
+// values take about a byte each.
+class IotLinkSeries {
+  public:
+    IotLinkSeries(IotLinkSample* samples, size_t capacity, uint8_t precision = 1)
+      : samples(samples), capacity(capacity), count(0), precision(precision > 6 ? 6 : precision) {}
+
+    bool add(float value) { return add(millis(), value); }
+    bool add(uint32_t time, float value);
+    void clear() { count = 0; }
+
+    size_t size() const { return count; }
+    bool isFull() const { return count == capacity; }
+    uint8_t getPrecision() const { return precision; }
+    const IotLinkSample& operator[](size_t index) const { return samples[index]; }
+
+    // length of the binary encoding
+    size_t encodedLength(uint32_t now) const;
+    // Base64 of the encoding into out (Base64Encoder::updateLen(encodedLength()) + 4 bytes),
+    // returns its length, not NUL terminated
+    size_t encodeBase64(char* out, uint32_t now) const;
+
+    // Reads an encoding back into samples (times relative to the first reading), returns the
+    // number of readings or -1 if data is not a valid encoding or they do not fit
+    static int decode(const uint8_t* data, size_t length, IotLinkSample* samples, size_t capacity, uint8_t& precision, uint32_t& age);
+
+  private:
+    template <typename Sink>
+    void encode(uint32_t now, Sink& sink) const;
+    static uint32_t zigzag(int32_t value) { return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31); }
+    static int32_t unzigzag(uint32_t value) { return (int32_t) (value >> 1) ^ -(int32_t) (value & 1); }
+
+    IotLinkSample* samples;
+    size_t capacity;
+    size_t count;
+    uint8_t precision;
+};
+
+bool IotLinkSeries::add(uint32_t time, float value) {
+  if (count == capacity) return false;
+  float scaled = value;
+  for (uint8_t i = 0; i < precision; i++) scaled *= 10;
+  // the largest float below 2^31, NaN fails both comparisons
+  if (!(scaled >= -2147483648.0f && scaled <= 2147483520.0f)) return false;
+  samples[count].time = time;
+  samples[count].value = (int32_t) lroundf(scaled);
+  count++;
+  return true;
+}
+
+template <typename Sink>
+void IotLinkSeries::encode(uint32_t now, Sink& sink) const {
+  auto varint = [&sink](uint64_t value) {
+    uint8_t bytes[10];
+    size_t n = 0;
+    do {
+      bytes[n] = value & 0x7f;
+      value >>= 7;
+      if (value) bytes[n] |= 0x80;
+      n++;
+    } while (value);
+    sink.put(bytes, n);
+  };
+  uint32_t zeros = 0;
+  auto entry = [&](uint32_t difference) {
+    if (difference == 0) { zeros++; return; }
+    if (zeros) varint(zeros == 1 ? 0 : ((uint64_t) zeros << 1) | 1);
+    zeros = 0;
+    varint((uint64_t) zigzag((int32_t) difference) << 1);
+  };
+  auto endColumn = [&]() {
+    if (zeros) varint(zeros == 1 ? 0 : ((uint64_t) zeros << 1) | 1);
+    zeros = 0;
+  };
+
+  uint8_t head[2] = { 1, precision };
+  sink.put(head, 2);
+  varint(count);
+  varint(count ? now - samples[0].time : 0);
+
+  uint32_t lastDelta = 0;
+  for (size_t i = 1; i < count; i++) {
+    uint32_t delta = samples[i].time - samples[i - 1].time;
+    entry(delta - lastDelta);
+    lastDelta = delta;
+  }
+  endColumn();
+  for (size_t i = 0; i < count; i++) {
+    entry(i ? (uint32_t) samples[i].value - (uint32_t) samples[i - 1].value : (uint32_t) samples[0].value);
+  }
+  endColumn();
+}
+
+size_t IotLinkSeries::encodedLength(uint32_t now) const {
+  struct {
+    size_t length = 0;
+    void put(const uint8_t*, size_t n) { length += n; }
+  } counter;
+  encode(now, counter);
+  return counter.length;
+}
+
+size_t IotLinkSeries::encodeBase64(char* out, uint32_t now) const {
+  struct {
+    Base64Encoder encoder;
+    char* out;
+    void put(const uint8_t* bytes, size_t n) { out += encoder.update(out, bytes, n); }
+  } writer;
+  writer.out = out;
+  encode(now, writer);
+  writer.out += writer.encoder.final(writer.out);
+  return writer.out - out;
+}
+
+int IotLinkSeries::decode(const uint8_t* data, size_t length, IotLinkSample* samples, size_t capacity, uint8_t& precision, uint32_t& age) {
+  const uint8_t* p = data;
+  const uint8_t* end = data + length;
+  bool failed = false;
+  auto varint = [&]() -> uint64_t {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (p >= end) break;
+      uint8_t byte = *p++;
+      value |= (uint64_t) (byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return value;
+    }
+    failed = true;
+    return 0;
+  };
+  // next entry of a column, zeros pending from a run
+  uint64_t zeros = 0;
+  auto entry = [&]() -> uint32_t {
+    if (zeros) { zeros--; return 0; }
+    uint64_t token = varint();
+    if (token & 1) {
+      zeros = (token >> 1) - 1;
+      return 0;
+    }
+    return (uint32_t) unzigzag((uint32_t) (token >> 1));
+  };
+
+  if (length < 2 || data[0] != 1 || data[1] > 6) return -1;
+  precision = data[1];
+  p += 2;
+  uint64_t count = varint();
+  age = (uint32_t) varint();
+  if (failed || count > capacity) return -1;
+
+  uint32_t delta = 0;
+  if (count) samples[0].time = 0;
+  for (uint32_t i = 1; i < count; i++) {
+    delta += entry();
+    samples[i].time = samples[i - 1].time + delta;
+  }
+  if (zeros) return -1;
+  uint32_t value = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    value += entry();
+    samples[i].value = (int32_t) value;
+  }
+  return failed || zeros || p != end ? -1 : (int) count;
+}
+
+#endif
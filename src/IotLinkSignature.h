@@ -3,42 +3,103 @@
 
 #include "extralib/Crypto/Crypto.h"
 #include "extralib/Crypto/Base64.h"
+#include "IotLinkMessageTemplate.h"
 
-String calculateSignature(const char* key, JsonDocument &jsonMessage) {
-  if (!jsonMessage.containsKey("payload")) return String("");
-  String jsonPayload; serializeJson(jsonMessage["payload"], jsonPayload);
-  //Serial.println(jsonPayload);
+#define SIGNATURE_LENGTH 44 // base64 of a SHA256 HMAC
+
+// ArduinoJson writer feeding the serialized text straight into the HMAC,
+// so the payload never has to exist as a String
+class HMACWriter {
+  public:
+    HMACWriter(SHA256HMAC& hmac) : _hmac(hmac) {}
+    size_t write(uint8_t c) { _hmac.doUpdate(&c, 1); return 1; }
+    size_t write(const uint8_t* s, size_t n) { _hmac.doUpdate(s, n); return n; }
+  private:
+    SHA256HMAC& _hmac;
+};
 
+void encodeSignature(SHA256HMAC& hmac, char signature[SIGNATURE_LENGTH + 1]) {
   byte rawSigBuf[SHA256HMAC_SIZE];
-  String test;
-  
+  hmac.doFinal(rawSigBuf);
+  base64_encode(signature, (char*) rawSigBuf, SHA256HMAC_SIZE);
+  signature[SIGNATURE_LENGTH] = '\0';
+}
+
+bool calculateSignature(const char* key, JsonDocument &jsonMessage, char signature[SIGNATURE_LENGTH + 1]) {
+  signature[0] = '\0';
+  if (!jsonMessage.containsKey("payload")) return false;
 
   SHA256HMAC hmac((byte*) key, strlen(key));
-  hmac.doUpdate(jsonPayload.c_str(), jsonPayload.length());
-  hmac.doFinal(rawSigBuf);
-  
+  HMACWriter writer(hmac);
+  serializeJson(jsonMessage["payload"], writer);
+  encodeSignature(hmac, signature);
+  return true;
+}
+
+// signature over the MessagePack encoding of the payload, used for binary frames
+bool calculateMsgPackSignature(const char* key, JsonDocument &jsonMessage, char signature[SIGNATURE_LENGTH + 1]) {
+  signature[0] = '\0';
+  if (!jsonMessage.containsKey("payload")) return false;
 
-  int b64_len = base64_enc_len(SHA256HMAC_SIZE);
-  char sigBuf[b64_len+1];
-  base64_encode(sigBuf, (char*) rawSigBuf, SHA256HMAC_SIZE);
-  sigBuf[b64_len] = 0;
-  String result = sigBuf;
+  SHA256HMAC hmac((byte*) key, strlen(key));
+  HMACWriter writer(hmac);
+  serializeMsgPack(jsonMessage["payload"], writer);
+  encodeSignature(hmac, signature);
+  return true;
+}
+
+// signature of an already serialized payload
+void calculateSignature(const char* key, const char* payload, size_t length, char signature[SIGNATURE_LENGTH + 1]) {
+  SHA256HMAC hmac((byte*) key, strlen(key));
+  hmac.doUpdate(payload, length);
+  encodeSignature(hmac, signature);
+}
+
+// Completes the message around the payload text at buffer + sizeof(IOTLINK_MESSAGE_HEADER) - 1
+// with header and signature, returns the length of the message
+size_t frameMessage(const char* key, char* buffer, size_t length) {
+  const size_t payloadOffset = sizeof(IOTLINK_MESSAGE_HEADER) - 1;
+  char* payload = buffer + payloadOffset;
+  char* p = payload + length;
+
+  memcpy(buffer, IOTLINK_MESSAGE_HEADER, payloadOffset);
+  memcpy(p, IOTLINK_MESSAGE_SIGNATURE, sizeof(IOTLINK_MESSAGE_SIGNATURE) - 1);
+  p += sizeof(IOTLINK_MESSAGE_SIGNATURE) - 1;
+  calculateSignature(key, payload, length, p);
+  p += SIGNATURE_LENGTH;
+  memcpy(p, IOTLINK_MESSAGE_TRAILER, sizeof(IOTLINK_MESSAGE_TRAILER) - 1);
+  p += sizeof(IOTLINK_MESSAGE_TRAILER) - 1;
+  return p - buffer;
+}
+
+String calculateSignature(const char* key, JsonDocument &jsonMessage) {
+  char sigBuf[SIGNATURE_LENGTH + 1];
+  calculateSignature(key, jsonMessage, sigBuf);
+  return String(sigBuf);
+}
 
-  return result;
+bool verifyMessage(const String& key, JsonDocument &jsonMessage) {
+  const char* jsonHash = jsonMessage["signature"]["HMAC"];
+  char calculatedHash[SIGNATURE_LENGTH + 1];
+  if (!jsonHash || !calculateSignature(key.c_str(), jsonMessage, calculatedHash)) return false;
+  return strcmp(jsonHash, calculatedHash) == 0;
 }
 
-bool verifyMessage(String key, JsonDocument &jsonMessage) {
-  String jsonHash = jsonMessage["signature"]["HMAC"];
-  String calculatedHash = calculateSignature(key.c_str(), jsonMessage);
-  return jsonHash == calculatedHash;
+// checks hmac against the payload text exactly as it was received
+bool verifyMessage(const String& key, const char* payload, size_t length, const char* hmac) {
+  if (!hmac) return false;
+  char calculatedHash[SIGNATURE_LENGTH + 1];
+  calculateSignature(key.c_str(), payload, length, calculatedHash);
+  return strcmp(hmac, calculatedHash) == 0;
 }
 
-String signMessage(String key, JsonDocument &jsonMessage) {
+bool signMessage(const String& key, JsonDocument &jsonMessage, bool msgPack = false) {
+  char sigBuf[SIGNATURE_LENGTH + 1];
+  bool calculated = msgPack ? calculateMsgPackSignature(key.c_str(), jsonMessage, sigBuf) : calculateSignature(key.c_str(), jsonMessage, sigBuf);
+  if (!calculated) return false;
   if (!jsonMessage.containsKey("signature")) jsonMessage.createNestedObject("signature");
-  jsonMessage["signature"]["HMAC"] = calculateSignature(key.c_str(), jsonMessage);
-  String signedMessageString;
-  serializeJson(jsonMessage, signedMessageString);
-  return signedMessageString;
+  jsonMessage["signature"]["HMAC"] = sigBuf; // char[] is copied into the document
+  return true;
 }
 
-#endif // _SIGNATURE_H_
\ No newline at end of file
+#endif // _SIGNATURE_H_
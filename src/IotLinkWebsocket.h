@@ -13,7 +13,11 @@
 #include "IotLinkDebug.h"
 #include "IotLinkConfig.h"
 #include "IotLinkInterface.h"
+#include "IotLinkDeviceIndex.h"
 #include "IotLinkSignature.h"
+#include "IotLinkJsonReader.h"
+#include "IotLinkMsgPackReader.h"
+#include "IotLinkDeflate.h"
 
 class websocketListener
 {
@@ -24,41 +28,71 @@ class websocketListener
     websocketListener();
     ~websocketListener();
 
-    void begin(String server, String socketAuthToken, String signingKey, std::vector<IotLinkDeviceInterface*> devices, String deviceIds);
+    void begin(String server, String socketAuthToken, String signingKey, const IotLinkDeviceIndex* devices, String deviceIds);
     void handle();
     void stop();
     bool isConnected() { return _isConnected; }
+    // true once the server answered the encoding header with a binary frame, until disconnect
+    bool isBinary() { return _isBinary; }
     void setRestoreDeviceStates(bool flag) { this->restoreDeviceStates = flag; };
 
+    void setMessagePool(IotLinkMessagePool* pool) { messagePool = pool; }
+
     void sendMessage(String &message);
+    void sendMessage(const char* message, size_t length);
+    void sendBinary(const uint8_t* message, size_t length);
     void extractTimestamp(JsonDocument &message);
-    DynamicJsonDocument prepareResponse(JsonDocument& requestMessage);
-    void handleResponse(DynamicJsonDocument& responseMessage);
-    void handleRequest(DynamicJsonDocument& requestMessage);
+    IotLinkMessage prepareResponse(JsonDocument& requestMessage);
+    void handleResponse(JsonDocument& responseMessage);
+    void handleRequest(JsonDocument& requestMessage);
 
     void onConnected(wsConnectedCallback callback) { _wsConnectedCb = callback; }
     void onDisconnected(wsDisconnectedCallback callback) { _wsDisconnectedCb = callback; }
+    // internal counterpart of onConnected, called after it
+    void onReady(wsConnectedCallback callback) { _wsReadyCb = callback; }
 
     void disconnect() { webSocket.disconnect(); }
   private:
     bool _begin = false;
     bool _isConnected = false;
+    bool _isBinary = false;
+    bool _isCompressed = false;
     bool restoreDeviceStates = false;
 
     WebSocketsClient webSocket;
 
     wsConnectedCallback _wsConnectedCb;
     wsDisconnectedCallback _wsDisconnectedCb;
+    wsConnectedCallback _wsReadyCb;
 
     void webSocketEvent(WStype_t type, uint8_t * payload, size_t length);
+    bool parseMessage(const char* request, size_t length, IotLinkMessage& jsonMessage, bool msgPack = false);
+    void dispatchMessage(JsonDocument& jsonMessage, bool sigMatch);
+    void handleText(char* request, size_t length);
+#if IOTLINK_MSGPACK
+    void handleMsgPack(const uint8_t* payload, size_t length);
+#endif
+#if IOTLINK_DEFLATE
+    void handleCompressed(const uint8_t* payload, size_t length);
+    bool sendCompressed(const uint8_t* message, size_t length);
+#endif
+    bool handleFastRequest(const char* request, size_t length);
     void setExtraHeaders();
-    std::vector<IotLinkDeviceInterface*> devices;
+    const IotLinkDeviceIndex* devices = nullptr;
     String deviceIds;
     String socketAuthToken;
     unsigned long getTimestamp() { return baseTimestamp + (millis()/1000); }
     unsigned long baseTimestamp = 0;
     String responseMessageStr = "";
     String signingKey;
+    IotLinkMessagePool* messagePool = nullptr;
+    StaticJsonDocument<384> inboundFilter; // fields of incoming messages the pipeline uses
+#if IOTLINK_DEFLATE
+    // one buffer per direction, a request handler may send while its message is still in use
+    char inflated[IOTLINK_INBOUND_MAX_LENGTH + 1];
+    uint8_t deflated[IOTLINK_DEFLATE_MAX_LENGTH];
+    uint16_t deflateHead[IOTLINK_DEFLATE_HASH_SIZE];
+#endif
 };
 
 void websocketListener::setExtraHeaders() {
@@ -72,17 +106,34 @@ void websocketListener::setExtraHeaders() {
          headers += "platform:ESP32\r\n";
   #endif
          headers += "version:" + String(IOTLINK_VERSION);
+  #if IOTLINK_MSGPACK
+         headers += "\r\nencoding:msgpack";
+  #endif
+  #if IOTLINK_DEFLATE
+         headers += "\r\ncompression:" IOTLINK_DEFLATE_NAME;
+  #endif
   DEBUG_IOTLINK("[IotLink:Websocket]: headers: \r\n%s\r\n", headers.c_str());
   webSocket.setExtraHeaders(headers.c_str());
 }
 
-websocketListener::websocketListener() : _isConnected(false) {}
+websocketListener::websocketListener() : _isConnected(false) {
+  inboundFilter["timestamp"] = true;
+  JsonObject payload = inboundFilter.createNestedObject("payload");
+  payload["action"] = true;
+  payload["clientId"] = true;
+  payload["createdAt"] = true;
+  payload["deviceId"] = true;
+  payload["replyToken"] = true;
+  payload["type"] = true;
+  payload["value"] = true;
+  inboundFilter["signature"]["HMAC"] = true;
+}
 
 websocketListener::~websocketListener() {
   stop();
 }
 
-void websocketListener::begin(String server, String socketAuthToken, String signingKey, std::vector<IotLinkDeviceInterface*> devices, String deviceIds) {
+void websocketListener::begin(String server, String socketAuthToken, String signingKey, const IotLinkDeviceIndex* devices, String deviceIds) {
   if (_begin) return;
   _begin = true;
   this->socketAuthToken = socketAuthToken;
@@ -114,9 +165,26 @@ void websocketListener::stop() {
 
 void websocketListener::sendMessage(String &message) {
   //Serial.println(message);
+#if IOTLINK_DEFLATE
+  if (sendCompressed((const uint8_t*) message.c_str(), message.length())) return;
+#endif
   webSocket.sendTXT(message);
 }
 
+void websocketListener::sendMessage(const char* message, size_t length) {
+#if IOTLINK_DEFLATE
+  if (sendCompressed((const uint8_t*) message, length)) return;
+#endif
+  webSocket.sendTXT(message, length);
+}
+
+void websocketListener::sendBinary(const uint8_t* message, size_t length) {
+#if IOTLINK_DEFLATE
+  if (sendCompressed(message, length)) return;
+#endif
+  webSocket.sendBIN(message, length);
+}
+
 void websocketListener::extractTimestamp(JsonDocument &message) {
     unsigned long tempTimestamp = 0;
     // extract timestamp from timestamp message right after websocket connection is established
@@ -136,13 +204,13 @@ void websocketListener::extractTimestamp(JsonDocument &message) {
     }
 }
 
-DynamicJsonDocument websocketListener::prepareResponse(JsonDocument& requestMessage) {
-    DynamicJsonDocument responseMessage(1024);
-    JsonObject header = responseMessage.createNestedObject("header");
+IotLinkMessage websocketListener::prepareResponse(JsonDocument& requestMessage) {
+    IotLinkMessage responseMessage = messagePool->borrow();
+    JsonObject header = responseMessage->createNestedObject("header");
     header["payloadVersion"] = 2;
     header["signatureVersion"] = 1;
 
-    JsonObject payload = responseMessage.createNestedObject("payload");
+    JsonObject payload = responseMessage->createNestedObject("payload");
     payload["action"] = requestMessage["payload"]["action"];
     payload["clientId"] = requestMessage["payload"]["clientId"];
     payload["createdAt"] = 0;
@@ -155,7 +223,7 @@ DynamicJsonDocument websocketListener::prepareResponse(JsonDocument& requestMess
     return responseMessage;
 }
 
-void websocketListener::handleResponse(DynamicJsonDocument& responseMessage) {
+void websocketListener::handleResponse(JsonDocument& responseMessage) {
     DEBUG_IOTLINK("[IotLink.handleResponse()]:\r\n");
 
 #ifndef NODEBUG_IOTLINK
@@ -164,13 +232,13 @@ void websocketListener::handleResponse(DynamicJsonDocument& responseMessage) {
 #endif
 }
 
-void websocketListener::handleRequest(DynamicJsonDocument& requestMessage) {
+void websocketListener::handleRequest(JsonDocument& requestMessage) {
     DEBUG_IOTLINK("[IotLink.handleRequest()]: handling request\r\n");
 #ifndef NODEBUG_IOTLINK
     serializeJsonPretty(requestMessage, DEBUG_ESP_PORT);
 #endif
 
-    DynamicJsonDocument responseMessage = prepareResponse(requestMessage);
+    IotLinkMessage responseMessage = prepareResponse(requestMessage);
 
     // handle devices
     bool success = false;
@@ -179,18 +247,16 @@ void websocketListener::handleRequest(DynamicJsonDocument& requestMessage) {
     JsonObject request_value = requestMessage["payload"]["value"];
     JsonObject response_value = responseMessage["payload"]["value"];
 
-    for (auto& device : devices) {
-
-        if (strcmp(deviceId, device->getDeviceId()) == 0 && success == false) {
-            success = device->handleRequest(deviceId, action, request_value, response_value);
-            responseMessage["payload"]["success"] = success;
-            if (!success) {
-                if (responseMessageStr.length() > 0){
-                    responseMessage["payload"]["message"] = responseMessageStr;
-                    responseMessageStr = "";
-                } else {
-                    responseMessage["payload"]["message"] = "Device returned an error while processing the request!";
-                }
+    IotLinkDeviceInterface* device = devices ? devices->find(deviceId) : nullptr;
+    if (device) {
+        success = device->handleRequest(deviceId, action, request_value, response_value);
+        responseMessage["payload"]["success"] = success;
+        if (!success) {
+            if (responseMessageStr.length() > 0){
+                responseMessage["payload"]["message"] = responseMessageStr;
+                responseMessageStr = "";
+            } else {
+                responseMessage["payload"]["message"] = "Device returned an error while processing the request!";
             }
         }
     }
@@ -203,6 +269,169 @@ void websocketListener::handleRequest(DynamicJsonDocument& requestMessage) {
     }
 }
 
+// Handles a signed request straight from the received text when its payload fits
+// IotLinkFastRequest and the device has a fast handler for the action. Returns
+// false, with nothing handled yet, for everything else.
+bool websocketListener::handleFastRequest(const char* request, size_t length) {
+    IotLinkStringView rawPayload, rawSignature, hmac;
+    IotLinkJsonReader payloadReader(request, length);
+    if (!payloadReader.beginObject() || !payloadReader.findMember("payload", rawPayload)) return false;
+    IotLinkJsonReader signatureReader(request, length);
+    if (!signatureReader.beginObject() || !signatureReader.findMember("signature", rawSignature)) return false;
+    IotLinkJsonReader hmacReader(rawSignature.data, rawSignature.length);
+    if (!hmacReader.beginObject() || !hmacReader.findMember("HMAC", rawSignature)) return false;
+    IotLinkJsonReader(rawSignature.data, rawSignature.length).readString(hmac);
+
+    IotLinkFastRequest fastRequest;
+    if (!fastRequest.parse(rawPayload) || !fastRequest.type.equals("request")) return false;
+
+    char deviceId[DEVICEID_LENGTH + 1];
+    if (fastRequest.deviceId.length > DEVICEID_LENGTH) return false;
+    memcpy(deviceId, fastRequest.deviceId.data, fastRequest.deviceId.length);
+    deviceId[fastRequest.deviceId.length] = '\0';
+    IotLinkDeviceInterface* device = devices ? devices->find(deviceId) : nullptr;
+    if (!device) return false;
+
+    char calculatedHash[SIGNATURE_LENGTH + 1];
+    calculateSignature(signingKey.c_str(), rawPayload.data, rawPayload.length, calculatedHash);
+    if (hmac.length != SIGNATURE_LENGTH || memcmp(hmac.data, calculatedHash, SIGNATURE_LENGTH) != 0) return false;
+
+    if (fastRequest.createdAt) {
+        baseTimestamp = fastRequest.createdAt - (millis() / 1000);
+        DEBUG_IOTLINK("[IotLink:extractTimestamp(): Got Timestamp %lu\r\n", fastRequest.createdAt);
+    }
+
+    char value[IOTLINK_RESPONSE_VALUE_SIZE];
+    IotLinkTextWriter response_value(value, sizeof(value));
+    bool success = false;
+    if (!device->handleFastRequest(fastRequest, response_value, success)) return false;
+    DEBUG_IOTLINK("[IotLink.handleFastRequest()]: handled request\r\n");
+
+    // responses are not sent, as on the JsonDocument path in handleRequest()
+    if (!success) responseMessageStr = "";
+    return true;
+}
+
+// Parses only the fields in inboundFilter. Messages go into a pooled document and
+// only those that do not fit get a heap document sized from their length, capped
+// at IOTLINK_INBOUND_MAX_CAPACITY. Anything larger is rejected.
+bool websocketListener::parseMessage(const char* request, size_t length, IotLinkMessage& jsonMessage, bool msgPack) {
+  if (length > IOTLINK_INBOUND_MAX_LENGTH) {
+    DEBUG_IOTLINK("[IotLink:Websocket]: rejected message of %u bytes (limit %u)\r\n", (unsigned) length, (unsigned) IOTLINK_INBOUND_MAX_LENGTH);
+    return false;
+  }
+
+  jsonMessage = messagePool->borrow();
+  DeserializationError error = msgPack ? deserializeMsgPack(*jsonMessage, request, length, DeserializationOption::Filter(inboundFilter))
+                                       : deserializeJson(*jsonMessage, request, length, DeserializationOption::Filter(inboundFilter));
+
+  if (error == DeserializationError::NoMemory) {
+    size_t capacity = length * 2 < IOTLINK_INBOUND_MAX_CAPACITY ? length * 2 : IOTLINK_INBOUND_MAX_CAPACITY;
+    jsonMessage = IotLinkMessage(new DynamicJsonDocument(capacity));
+    error = msgPack ? deserializeMsgPack(*jsonMessage, request, length, DeserializationOption::Filter(inboundFilter))
+                    : deserializeJson(*jsonMessage, request, length, DeserializationOption::Filter(inboundFilter));
+  }
+
+  if (error) {
+    DEBUG_IOTLINK("[IotLink:Websocket]: rejected message: %s\r\n", error.c_str());
+    return false;
+  }
+  return true;
+}
+
+void websocketListener::dispatchMessage(JsonDocument& jsonMessage, bool sigMatch) {
+  const char* messageType = jsonMessage["payload"]["type"] | "";
+
+  if (sigMatch) {
+      extractTimestamp(jsonMessage);
+      Serial.println("signature match");
+      if (strcmp(messageType, "response") == 0) handleResponse(jsonMessage);
+      if (strcmp(messageType, "request") == 0) handleRequest(jsonMessage);
+  }else{
+      Serial.println("signature not match");
+  }
+}
+
+void websocketListener::handleText(char* request, size_t length) {
+  if (handleFastRequest(request, length)) return;
+
+  IotLinkMessage jsonMessage;
+  if (!parseMessage(request, length, jsonMessage)) return;
+
+  bool sigMatch = false;
+
+  if (strncmp(request, "{\"timestamp\":", 13) == 0 && strlen(request) <= 26) {
+      sigMatch=true;
+  } else {
+      // the filtered document no longer holds the whole payload, sign the received text instead
+      IotLinkJsonReader reader(request, length);
+      IotLinkStringView rawPayload;
+      sigMatch = reader.beginObject() && reader.findMember("payload", rawPayload) &&
+                 verifyMessage(signingKey, rawPayload.data, rawPayload.length, jsonMessage["signature"]["HMAC"]);
+  }
+
+  dispatchMessage(*jsonMessage, sigMatch);
+}
+
+#if IOTLINK_MSGPACK
+void websocketListener::handleMsgPack(const uint8_t* payload, size_t length) {
+  // the server answers "encoding:msgpack" by sending binary frames, reply the same way from now on
+  if (!_isBinary) DEBUG_IOTLINK("[IotLink:Websocket]: server switched to MessagePack\r\n");
+  _isBinary = true;
+
+  IotLinkMessage jsonMessage;
+  if (!parseMessage((const char*) payload, length, jsonMessage, true)) return;
+
+  bool sigMatch = false;
+  if (jsonMessage->containsKey("timestamp") && !jsonMessage->containsKey("payload")) {
+      sigMatch = true;
+  } else {
+      // signed over the MessagePack encoding of the payload, exactly as received
+      IotLinkMsgPackReader reader(payload, length);
+      IotLinkStringView rawPayload;
+      sigMatch = reader.beginObject() && reader.findMember("payload", rawPayload) &&
+                 verifyMessage(signingKey, rawPayload.data, rawPayload.length, jsonMessage["signature"]["HMAC"]);
+  }
+
+  dispatchMessage(*jsonMessage, sigMatch);
+}
+#endif
+
+#if IOTLINK_DEFLATE
+// A compressed frame is a binary frame holding IOTLINK_DEFLATE_MARKER and the raw
+// deflate stream of a text (or MessagePack) message, see IotLinkDeflate.h
+void websocketListener::handleCompressed(const uint8_t* payload, size_t length) {
+  if (!_isCompressed) DEBUG_IOTLINK("[IotLink:Websocket]: server switched to compressed frames\r\n");
+  _isCompressed = true;
+
+  char* message = inflated;
+  long messageLength = IotLinkDeflate::inflate(payload, length, (uint8_t*) message, IOTLINK_INBOUND_MAX_LENGTH);
+  if (messageLength < 0) {
+    DEBUG_IOTLINK("[IotLink:Websocket]: rejected compressed message (broken or larger than %u bytes)\r\n", (unsigned) IOTLINK_INBOUND_MAX_LENGTH);
+  } else {
+    message[messageLength] = '\0';
+#if IOTLINK_MSGPACK
+    if (messageLength && message[0] != '{') handleMsgPack((const uint8_t*) message, messageLength);
+    else
+#endif
+    handleText(message, messageLength);
+  }
+}
+
+// sends compressed when the server talks compressed and it pays off, false to send as is
+bool websocketListener::sendCompressed(const uint8_t* message, size_t length) {
+  if (!_isCompressed || length < IOTLINK_DEFLATE_MIN_LENGTH || length > IOTLINK_DEFLATE_MAX_LENGTH) return false;
+
+  // the marker and the stream, which has to be shorter than the message
+  size_t compressed = IotLinkDeflate::compress(message, length, deflated + 1, length - 1, deflateHead);
+  if (compressed) {
+    deflated[0] = IOTLINK_DEFLATE_MARKER;
+    webSocket.sendBIN(deflated, compressed + 1);
+  }
+  return compressed != 0;
+}
+#endif
+
 void websocketListener::webSocketEvent(WStype_t type, uint8_t * payload, size_t length)
 {
   switch (type) {
@@ -211,6 +440,8 @@ void websocketListener::webSocketEvent(WStype_t type, uint8_t * payload, size_t
         DEBUG_IOTLINK("[IotLink:Websocket]: disconnected\r\n");
         if (_wsDisconnectedCb) _wsDisconnectedCb();
         _isConnected = false;
+        _isBinary = false;
+        _isCompressed = false;
       }
       break;
     case WStype_CONNECTED:
@@ -221,6 +452,7 @@ void websocketListener::webSocketEvent(WStype_t type, uint8_t * payload, size_t
         restoreDeviceStates=false; 
         setExtraHeaders();
       }
+      if (_wsReadyCb) _wsReadyCb();
       break;
     case WStype_TEXT: {
 
@@ -229,30 +461,22 @@ void websocketListener::webSocketEvent(WStype_t type, uint8_t * payload, size_t
 //      DEBUG_IOTLINK("[IotLink:Websocket]: receiving data\r\n");
 	  Serial.println((char*)payload);
 
-	  DynamicJsonDocument jsonMessage(1024);
-	  deserializeJson(jsonMessage, request);
-
-	  bool sigMatch = false;
-
-	  if (strncmp(request, "{\"timestamp\":", 13) == 0 && strlen(request) <= 26) {
-	      sigMatch=true;
-	  } else {
-	      sigMatch = verifyMessage(signingKey, jsonMessage);
-	  }
-
-	  String messageType = jsonMessage["payload"]["type"];
-
-	  if (sigMatch) {
-	      extractTimestamp(jsonMessage);
-          Serial.println("signature match");
-	      if (messageType == "response") handleResponse(jsonMessage);
-	      if (messageType == "request") handleRequest(jsonMessage);
-	  }else{
-          Serial.println("signature not match");
-	  }
-
+	  handleText(request, length);
       break;
     }
+#if IOTLINK_MSGPACK || IOTLINK_DEFLATE
+    case WStype_BIN:
+#if IOTLINK_DEFLATE
+      if (length && payload[0] == IOTLINK_DEFLATE_MARKER) {
+          handleCompressed(payload + 1, length - 1);
+          break;
+      }
+#endif
+#if IOTLINK_MSGPACK
+      handleMsgPack(payload, length);
+#endif
+      break;
+#endif
     default: break;
   }
 }
@@ -1,15 +1,8 @@
 #include "AESLib.h"
-
-uint8_t AESLib::getrnd()
-{
-   uint8_t really_random = *(volatile uint8_t *)0x3FF20E44;
-   return really_random;
-}
+#include "RNG.h"
 
 void AESLib::gen_iv(byte  *iv) {
-    for (int i = 0 ; i < N_BLOCK ; i++ ) {
-        iv[i]= (byte) getrnd();
-    }
+    RNG::fill(iv, N_BLOCK);
 }
 
 /*String AESLib::decrypt(String msg, byte key[], byte my_iv[]) {
@@ -56,15 +49,136 @@ void AESLib::gen_iv(byte  *iv) {
 
 
 
-String AESLib::encrypt(String msg, byte key[], byte my_iv[]) {
-  char b64data[200];
-  byte cipher[1000];
-    
-  aes.set_key( key , sizeof(key));
-  base64_encode(b64data, (char *)my_iv, N_BLOCK);
-  int b64len = base64_encode(b64data, (char *)msg.c_str(),msg.length());
-  // Encrypt! With AES128, our key and IV, CBC and pkcs7 padding    
-  aes.do_aes_encrypt((byte *)b64data, b64len , cipher, key, 128, my_iv);
-  base64_encode(b64data, (char *)cipher, aes.get_size() );  
-  return String(b64data);  
-}
\ No newline at end of file
+size_t AESLib::encrypt_len(size_t msgLen) {
+  size_t b64len = (msgLen + 2) / 3 * 4;
+  size_t cipherLen = (b64len / N_BLOCK + 1) * N_BLOCK; // pkcs7 always adds 1..16 bytes
+  return (cipherLen + 2) / 3 * 4;
+}
+
+size_t AESLib::encrypt_update_len(size_t msgLen) {
+  size_t b64len = (msgLen + 2) / 3 * 4;
+  size_t cipherLen = (b64len + N_BLOCK - 1) / N_BLOCK * N_BLOCK;
+  return (cipherLen + 2) / 3 * 4;
+}
+
+int AESLib::set_key(const byte key[], int bits) {
+  byte len;
+  switch (bits) {
+    case 16: case 128: len = 16; break;
+    case 24: case 192: len = 24; break;
+    case 32: case 256: len = 32; break;
+    default: return -1;
+  }
+
+  int victim = -1;
+  for (int i = 0; i < AESLIB_KEY_SLOTS; i++) {
+    key_slot &slot = slots[i];
+    if (slot.key_len == len && memcmp(slot.key, key, len) == 0) {
+      slot.last_used = ++use_counter;
+      return i;
+    }
+    if (cipher == &slot.aes) continue; // pinned by the open stream
+    if (victim < 0 || (slots[victim].key_len && (slot.key_len == 0 || (uint16_t)(use_counter - slot.last_used) > (uint16_t)(use_counter - slots[victim].last_used)))) victim = i;
+  }
+  if (victim < 0) {
+    // the only slot belongs to the open stream: replace it and fail the stream
+    victim = 0;
+    cipher = nullptr;
+  }
+
+  key_slot &slot = slots[victim];
+  memcpy(slot.key, key, len);
+  slot.key_len = len;
+  slot.last_used = ++use_counter;
+  slot.aes.set_key(slot.key, len);
+  return victim;
+}
+
+bool AESLib::encrypt_begin(int keyHandle, byte my_iv[]) {
+  cipher = (keyHandle >= 0 && keyHandle < AESLIB_KEY_SLOTS && slots[keyHandle].key_len) ? &slots[keyHandle].aes : nullptr;
+  memcpy(iv, my_iv, N_BLOCK);
+  block_len = 0;
+  plain_b64.reset();
+  cipher_b64.reset();
+  return cipher != nullptr;
+}
+
+// inner Base64 text -> AES block
+size_t AESLib::push_plain(const byte *text, size_t len, char *output) {
+  size_t written = 0;
+  for (size_t i = 0; i < len; i++) {
+    block[block_len++] = text[i];
+    if (block_len == N_BLOCK) {
+      // CBC: chain through iv, which then holds the cipher block
+      for (byte j = 0; j < N_BLOCK; j++) iv[j] ^= block[j];
+      cipher->encrypt(iv, iv);
+      written += push_cipher(iv, output + written);
+      block_len = 0;
+    }
+  }
+  return written;
+}
+
+// one AES block -> outer Base64 text
+size_t AESLib::push_cipher(const byte *cipher, char *output) {
+  return cipher_b64.update(output, cipher, N_BLOCK);
+}
+
+size_t AESLib::encrypt_update(const void *msg, size_t msgLen, char *output) {
+  if (!cipher) return 0;
+  const byte *in = (const byte *) msg;
+  size_t written = 0;
+  while (msgLen) {
+    char text[64];
+    size_t len = msgLen < 48 ? msgLen : 48;
+    written += push_plain((byte *) text, plain_b64.update(text, in, len), output + written);
+    in += len;
+    msgLen -= len;
+  }
+  return written;
+}
+
+size_t AESLib::encrypt_final(char *output) {
+  if (!cipher) return 0;
+  char text[4];
+  size_t written = push_plain((byte *) text, plain_b64.final(text), output);
+
+  byte pad = N_BLOCK - block_len;
+  byte padding[N_BLOCK];
+  memset(padding, pad, pad);
+  written += push_plain(padding, pad, output + written);
+
+  written += cipher_b64.final(output + written);
+  cipher = nullptr;
+  return written;
+}
+
+size_t AESLib::encrypt(const void *msg, size_t msgLen, char *output, size_t outputLen, int keyHandle, byte my_iv[]) {
+  if (outputLen < encrypt_len(msgLen) + 1) return 0;
+  if (!encrypt_begin(keyHandle, my_iv)) return 0;
+  size_t written = encrypt_update(msg, msgLen, output);
+  written += encrypt_final(output + written);
+  output[written] = '\0';
+  return written;
+}
+
+String AESLib::encrypt(const String& msg, byte key[], byte my_iv[]) {
+  String result;
+  result.reserve(encrypt_len(msg.length()));
+
+  char chunk[96]; // >= encrypt_update_len(48) + 1 and >= AESLIB_FINAL_LEN + 1
+  const char *in = msg.c_str();
+  size_t left = msg.length();
+
+  if (!encrypt_begin(key, 128, my_iv)) return result;
+  while (left) {
+    size_t len = left < 48 ? left : 48;
+    chunk[encrypt_update(in, len, chunk)] = '\0';
+    result += chunk;
+    in += len;
+    left -= len;
+  }
+  chunk[encrypt_final(chunk)] = '\0';
+  result += chunk;
+  return result;
+}
@@ -5,16 +5,78 @@
 #include "AES.h"
 #include "Base64.h"
 
+// largest number of characters a single encrypt_final() call writes
+#define AESLIB_FINAL_LEN 48
+
+// number of expanded key schedules kept by one AESLib instance
+#ifndef AESLIB_KEY_SLOTS
+#define AESLIB_KEY_SLOTS 2
+#endif
+
 class AESLib
 {
-  public:    
+  public:
     void gen_iv(byte  *iv);
-    String encrypt(String msg, byte key[], byte my_iv[]);
+    String encrypt(const String& msg, byte key[], byte my_iv[]);
     //String decrypt(String msg, byte key[], byte my_iv[]);
-        
+
+    /* Streaming encryption into caller provided buffers.
+     *
+     * The output is Base64(AES-CBC(Base64(msg))) with pkcs7 padding. Both
+     * Base64 stages and the cipher run as one pipeline, so nothing beyond a
+     * single AES block is ever held back and the message can be fed in chunks
+     * of any size:
+     *
+     *   encrypt_begin(key, 128, iv);
+     *   out += encrypt_update(chunk, chunkLen, out);   // repeat
+     *   out += encrypt_final(out);
+     *
+     * encrypt_len() returns the exact total length up front,
+     * encrypt_update_len() the most a single encrypt_update() call can write.
+     * No terminating NUL is written by the streaming calls.
+     */
+    static size_t encrypt_len(size_t msgLen);
+    static size_t encrypt_update_len(size_t msgLen);
+
+    /* Keyed contexts.
+     *
+     * set_key() expands the key schedule once and keeps it in one of
+     * AESLIB_KEY_SLOTS slots (least recently used slot is replaced). It returns
+     * a handle for encrypt_begin(), or -1 if bits is not a valid AES key size.
+     * Calling it again with a cached key only costs a compare. The slot of a
+     * stream between encrypt_begin() and encrypt_final() is never replaced,
+     * unless it is the only one; that stream then fails (writes nothing more).
+     */
+    int set_key(const byte key[], int bits);
+
+    bool encrypt_begin(int keyHandle, byte my_iv[]);
+    bool encrypt_begin(byte key[], int bits, byte my_iv[]) { return encrypt_begin(set_key(key, bits), my_iv); }
+    size_t encrypt_update(const void *msg, size_t msgLen, char *output);
+    size_t encrypt_final(char *output);
+
+    // one shot version, output must hold encrypt_len(msgLen) + 1 bytes (NUL terminated); returns 0 if it does not
+    size_t encrypt(const void *msg, size_t msgLen, char *output, size_t outputLen, int keyHandle, byte my_iv[]);
+    size_t encrypt(const void *msg, size_t msgLen, char *output, size_t outputLen, byte key[], byte my_iv[]) { return encrypt(msg, msgLen, output, outputLen, set_key(key, 128), my_iv); }
+
   private:
-    uint8_t getrnd();
-    AES aes;
+    size_t push_plain(const byte *text, size_t len, char *output);
+    size_t push_cipher(const byte *cipher, char *output);
+
+    struct key_slot {
+      byte key[32];
+      byte key_len;        // 0 = slot unused
+      uint16_t last_used;
+      AES aes;
+    };
+    key_slot slots[AESLIB_KEY_SLOTS] = {};
+    uint16_t use_counter = 0;
+    AES *cipher = nullptr; // schedule used by the running stream
+
+    byte iv[N_BLOCK];
+    byte block[N_BLOCK];   // inner Base64 text waiting for a full AES block
+    byte block_len;
+    Base64Encoder plain_b64;
+    Base64Encoder cipher_b64;
 };
 
 
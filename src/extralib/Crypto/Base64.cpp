@@ -1,19 +1,86 @@
 #include "Base64.h"
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 #if (defined(__AVR__))
 #include <avr\pgmspace.h>
-#else
+#elif defined(ARDUINO)
 #include <pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(p) (*(const unsigned char *)(p))
+#endif
+
+/* Block kernels
+ *
+ * base64_encode/base64_decode run the bulk of their input through the
+ * fastest kernel available for the target and only handle the tail (and on
+ * decode anything that is not plain alphabet, i.e. padding or invalid
+ * characters) with the byte-wise code below:
+ *
+ *   AVX2 / SSSE3 (x86 host builds), NEON (aarch64 host builds)
+ *   32 bit word path with RAM lookup tables everywhere else (ESP8266/ESP32)
+ *
+ * The SIMD kernels follow Wojciech Mula's pshufb based encoder/decoder.
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define B64_AVX2
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define B64_SSSE3
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define B64_NEON
+#endif
+
+// on AVR the tables have to stay in flash, everywhere else they live in RAM
+#if (defined(__AVR__))
+#define B64_TABLE PROGMEM
+#define b64_table(t, i) pgm_read_byte(&(t)[i])
+#else
+#define B64_TABLE
+#define b64_table(t, i) ((t)[i])
 #endif
 
 const char PROGMEM b64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
     "abcdefghijklmnopqrstuvwxyz"
     "0123456789+/";
 
+static const unsigned char b64_enc_table[65] B64_TABLE = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    "abcdefghijklmnopqrstuvwxyz"
+    "0123456789+/";
+
+#define XX 0xff
+static const unsigned char b64_dec_table[256] B64_TABLE = {
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, 62, XX, XX, XX, 63,
+  52, 53, 54, 55, 56, 57, 58, 59, 60, 61, XX, XX, XX, XX, XX, XX,
+  XX,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, XX, XX, XX, XX, XX,
+  XX, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+#undef XX
+
 /* 'Private' declarations */
 inline void a3_to_a4(unsigned char * a4, unsigned char * a3);
 inline void a4_to_a3(unsigned char * a3, unsigned char * a4);
-inline unsigned char b64_lookup(char c);
+static size_t b64_encode_blocks(char *output, const unsigned char *input, size_t inputLen);
+static size_t b64_decode_blocks(unsigned char *output, const char *input, size_t inputLen);
 
 int base64_encode(char *output, char *input, int inputLen) {
   int i = 0, j = 0;
@@ -21,13 +88,20 @@ int base64_encode(char *output, char *input, int inputLen) {
   unsigned char a3[3];
   unsigned char a4[4];
 
+  if (inputLen > 0) {
+    int done = b64_encode_blocks(output, (const unsigned char *) input, inputLen);
+    input += done;
+    inputLen -= done;
+    encLen = done / 3 * 4;
+  }
+
   while(inputLen--) {
     a3[i++] = *(input++);
     if(i == 3) {
       a3_to_a4(a4, a3);
 
       for(i = 0; i < 4; i++) {
-        output[encLen++] = pgm_read_byte(&b64_alphabet[a4[i]]);
+        output[encLen++] = b64_table(b64_enc_table, a4[i]);
       }
 
       i = 0;
@@ -42,7 +116,7 @@ int base64_encode(char *output, char *input, int inputLen) {
     a3_to_a4(a4, a3);
 
     for(j = 0; j < i + 1; j++) {
-      output[encLen++] = pgm_read_byte(&b64_alphabet[a4[j]]);
+      output[encLen++] = b64_table(b64_enc_table, a4[j]);
     }
 
     while((i++ < 3)) {
@@ -59,6 +133,12 @@ int base64_decode(char * output, char * input, int inputLen) {
   unsigned char a3[3];
   unsigned char a4[4];
 
+  if (inputLen > 0) {
+    int done = b64_decode_blocks((unsigned char *) output, input, inputLen);
+    input += done;
+    inputLen -= done;
+    decLen = done / 4 * 3;
+  }
 
   while (inputLen--) {
     if(*input == '=') {
@@ -68,7 +148,7 @@ int base64_decode(char * output, char * input, int inputLen) {
     a4[i++] = *(input++);
     if (i == 4) {
       for (i = 0; i <4; i++) {
-        a4[i] = b64_lookup(a4[i]);
+        a4[i] = b64_table(b64_dec_table, a4[i]);
       }
 
       a4_to_a3(a3,a4);
@@ -86,7 +166,7 @@ int base64_decode(char * output, char * input, int inputLen) {
     }
 
     for (j = 0; j <4; j++) {
-      a4[j] = b64_lookup(a4[j]);
+      a4[j] = b64_table(b64_dec_table, a4[j]);
     }
 
     a4_to_a3(a3,a4);
@@ -99,6 +179,95 @@ int base64_decode(char * output, char * input, int inputLen) {
   return decLen;
 }
 
+size_t Base64Encoder::update(char *output, const void *input, size_t inputLen) {
+  const unsigned char *in = (const unsigned char *) input;
+  size_t encLen = 0;
+
+  while (_len && inputLen) {
+    _carry[_len++] = *in++;
+    inputLen--;
+    if (_len == 3) {
+      b64_encode_blocks(output, _carry, 3);
+      encLen = 4;
+      _len = 0;
+    }
+  }
+
+  size_t done = b64_encode_blocks(output + encLen, in, inputLen);
+  encLen += done / 3 * 4;
+  in += done;
+  inputLen -= done;
+
+  while (inputLen--) _carry[_len++] = *in++;
+  return encLen;
+}
+
+size_t Base64Encoder::final(char *output) {
+  if (!_len) return 0;
+  unsigned char a4[4];
+  if (_len == 1) _carry[1] = 0;
+  _carry[2] = 0;
+  a3_to_a4(a4, _carry);
+  output[0] = b64_table(b64_enc_table, a4[0]);
+  output[1] = b64_table(b64_enc_table, a4[1]);
+  output[2] = _len == 2 ? b64_table(b64_enc_table, a4[2]) : '=';
+  output[3] = '=';
+  _len = 0;
+  return 4;
+}
+
+int Base64Decoder::update(unsigned char *output, const char *input, size_t inputLen) {
+  if (_failed) return -1;
+  size_t i = 0;
+  int decLen = 0;
+
+  while (i < inputLen) {
+    if (_len == 0 && !_done) {
+      size_t done = b64_decode_blocks(output + decLen, input + i, inputLen - i);
+      i += done;
+      decLen += done / 4 * 3;
+      if (i == inputLen) break;
+    }
+
+    unsigned char c = input[i++];
+    if (_done) return fail();
+
+    if (c == '=') {
+      if (_len < 2) return fail();
+      _quad[_len++] = 0;
+      _pad++;
+    } else {
+      unsigned char d = b64_table(b64_dec_table, c);
+      if ((d & 0x80) || _pad) return fail();
+      _quad[_len++] = d;
+    }
+
+    if (_len == 4) {
+      unsigned char a3[3];
+      a4_to_a3(a3, _quad);
+      for (int j = 0; j < 3 - _pad; j++) output[decLen++] = a3[j];
+      _done = _pad != 0;
+      _len = 0;
+    }
+  }
+  return decLen;
+}
+
+int Base64Decoder::final(unsigned char *output) {
+  if (_failed) return -1;
+  int decLen = 0;
+  if (_len) {
+    if (_len - _pad < 2) return fail();
+    for (int j = _len; j < 4; j++) _quad[j] = 0;
+    unsigned char a3[3];
+    a4_to_a3(a3, _quad);
+    decLen = _len - _pad - 1;
+    for (int j = 0; j < decLen; j++) output[j] = a3[j];
+  }
+  reset();
+  return decLen;
+}
+
 int base64_enc_len(int plainLen) {
   int n = plainLen;
   return (n + 2 - ((n + 2) % 3)) / 3 * 4;
@@ -127,12 +296,231 @@ inline void a4_to_a3(unsigned char * a3, unsigned char * a4) {
   a3[2] = ((a4[2] & 0x3) << 6) + a4[3];
 }
 
-inline unsigned char b64_lookup(char c) {
-  if(c >='A' && c <='Z') return c - 'A';
-  if(c >='a' && c <='z') return c - 71;
-  if(c >='0' && c <='9') return c + 4;
-  if(c == '+') return 62;
-  if(c == '/') return 63;
-  return -1;
+/* Kernels
+ *
+ * b64_encode_blocks encodes whole 3 byte groups and returns the number of
+ * input bytes consumed (a multiple of 3).
+ * b64_decode_blocks decodes whole 4 character groups of plain alphabet and
+ * returns the number of characters consumed (a multiple of 4); it stops in
+ * front of the first group holding '=' or an invalid character.
+ * Both write exactly 4 (3) bytes per group and never write ahead of what
+ * they have read, so decoding may run in place.
+ */
+
+#if defined(B64_SSSE3)
+static inline __m128i b64_enc_reshuffle_ssse3(__m128i in) {
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(t1, t3);
+}
+
+static inline __m128i b64_enc_translate_ssse3(__m128i in) {
+  const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+  __m128i indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+  indices = _mm_sub_epi8(indices, _mm_cmpgt_epi8(in, _mm_set1_epi8(25)));
+  return _mm_add_epi8(in, _mm_shuffle_epi8(lut, indices));
+}
+
+// returns false if the block holds anything but alphabet characters
+static inline bool b64_dec_translate_ssse3(__m128i &str) {
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2f);
+
+  const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+  const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+  const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+  const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff) return false;
+
+  const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+  const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+  str = _mm_add_epi8(str, roll);
+  return true;
+}
+
+static inline __m128i b64_dec_reshuffle_ssse3(__m128i in) {
+  const __m128i merge_ab_and_bc = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+  const __m128i out = _mm_madd_epi16(merge_ab_and_bc, _mm_set1_epi32(0x00011000));
+  return _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+#endif
+
+#if defined(B64_AVX2)
+static inline __m256i b64_enc_reshuffle_avx2(__m256i in) {
+  in = _mm256_shuffle_epi8(in, _mm256_set_epi8(
+    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+    10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+  const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+  const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+  const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+  return _mm256_or_si256(t1, t3);
+}
+
+static inline __m256i b64_enc_translate_avx2(__m256i in) {
+  const __m256i lut = _mm256_setr_epi8(
+    65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+    65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+  __m256i indices = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+  indices = _mm256_sub_epi8(indices, _mm256_cmpgt_epi8(in, _mm256_set1_epi8(25)));
+  return _mm256_add_epi8(in, _mm256_shuffle_epi8(lut, indices));
+}
+
+static inline bool b64_dec_translate_avx2(__m256i &str) {
+  const __m256i lut_lo = _mm256_setr_epi8(
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m256i lut_hi = _mm256_setr_epi8(
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+
+  const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+  const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+  const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+  const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+  if (!_mm256_testz_si256(lo, hi)) return false;
+
+  const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+  const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+  str = _mm256_add_epi8(str, roll);
+  return true;
+}
+
+static inline __m256i b64_dec_reshuffle_avx2(__m256i in) {
+  const __m256i merge_ab_and_bc = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+  const __m256i out = _mm256_madd_epi16(merge_ab_and_bc, _mm256_set1_epi32(0x00011000));
+  return _mm256_shuffle_epi8(out, _mm256_setr_epi8(
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+#endif
+
+static size_t b64_encode_blocks(char *output, const unsigned char *input, size_t inputLen) {
+  size_t i = 0;
+  char *out = output;
+
+#if defined(B64_AVX2)
+  // two overlapping 16 byte loads, 12 bytes used from each
+  for (; inputLen - i >= 28; i += 24, out += 32) {
+    __m256i str = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (input + i))),
+                                          _mm_loadu_si128((const __m128i *) (input + i + 12)), 1);
+    str = b64_enc_translate_avx2(b64_enc_reshuffle_avx2(str));
+    _mm256_storeu_si256((__m256i *) out, str);
+  }
+#endif
+#if defined(B64_SSSE3)
+  for (; inputLen - i >= 16; i += 12, out += 16) {
+    __m128i str = _mm_loadu_si128((const __m128i *) (input + i));
+    str = b64_enc_translate_ssse3(b64_enc_reshuffle_ssse3(str));
+    _mm_storeu_si128((__m128i *) out, str);
+  }
+#endif
+#if defined(B64_NEON)
+  if (inputLen - i >= 48) {
+    uint8x16x4_t table;
+    table.val[0] = vld1q_u8(b64_enc_table);
+    table.val[1] = vld1q_u8(b64_enc_table + 16);
+    table.val[2] = vld1q_u8(b64_enc_table + 32);
+    table.val[3] = vld1q_u8(b64_enc_table + 48);
+    const uint8x16_t mask = vdupq_n_u8(0x3f);
+    for (; inputLen - i >= 48; i += 48, out += 64) {
+      uint8x16x3_t src = vld3q_u8(input + i);
+      uint8x16x4_t dst;
+      dst.val[0] = vshrq_n_u8(src.val[0], 2);
+      dst.val[1] = vandq_u8(vorrq_u8(vshrq_n_u8(src.val[1], 4), vshlq_n_u8(src.val[0], 4)), mask);
+      dst.val[2] = vandq_u8(vorrq_u8(vshrq_n_u8(src.val[2], 6), vshlq_n_u8(src.val[1], 2)), mask);
+      dst.val[3] = vandq_u8(src.val[2], mask);
+      for (int k = 0; k < 4; k++) dst.val[k] = vqtbl4q_u8(table, dst.val[k]);
+      vst4q_u8((uint8_t *) out, dst);
+    }
+  }
+#endif
+
+  // 32 bit word path: one 24 bit load, one 32 bit store per group
+  for (; inputLen - i >= 3; i += 3, out += 4) {
+    uint32_t v = ((uint32_t) input[i] << 16) | ((uint32_t) input[i + 1] << 8) | input[i + 2];
+    const unsigned char a4[4] = {
+      b64_table(b64_enc_table, v >> 18),
+      b64_table(b64_enc_table, (v >> 12) & 0x3f),
+      b64_table(b64_enc_table, (v >> 6) & 0x3f),
+      b64_table(b64_enc_table, v & 0x3f)
+    };
+    memcpy(out, a4, 4);
+  }
+  return i;
 }
 
+static size_t b64_decode_blocks(unsigned char *output, const char *input, size_t inputLen) {
+  size_t i = 0;
+  unsigned char *out = output;
+
+#if defined(B64_AVX2)
+  for (; inputLen - i >= 32; i += 32, out += 24) {
+    __m256i str = _mm256_loadu_si256((const __m256i *) (input + i));
+    if (!b64_dec_translate_avx2(str)) break;
+    unsigned char tmp[32];
+    _mm256_storeu_si256((__m256i *) tmp, b64_dec_reshuffle_avx2(str));
+    memcpy(out, tmp, 12);
+    memcpy(out + 12, tmp + 16, 12);
+  }
+#endif
+#if defined(B64_SSSE3)
+  for (; inputLen - i >= 16; i += 16, out += 12) {
+    __m128i str = _mm_loadu_si128((const __m128i *) (input + i));
+    if (!b64_dec_translate_ssse3(str)) break;
+    unsigned char tmp[16];
+    _mm_storeu_si128((__m128i *) tmp, b64_dec_reshuffle_ssse3(str));
+    memcpy(out, tmp, 12);
+  }
+#endif
+#if defined(B64_NEON)
+  if (inputLen - i >= 64) {
+    // values 0..63 come from the low table, 64..127 from the high one, anything above is invalid
+    uint8x16x4_t table_lo, table_hi;
+    for (int k = 0; k < 4; k++) {
+      table_lo.val[k] = vld1q_u8(b64_dec_table + 16 * k);
+      table_hi.val[k] = vld1q_u8(b64_dec_table + 64 + 16 * k);
+    }
+    const uint8x16_t offset = vdupq_n_u8(64);
+    const uint8x16_t high = vdupq_n_u8(128);
+    for (; inputLen - i >= 64; i += 64, out += 48) {
+      uint8x16x4_t src = vld4q_u8((const uint8_t *) input + i);
+      uint8x16_t err = vdupq_n_u8(0);
+      for (int k = 0; k < 4; k++) {
+        uint8x16_t c = src.val[k];
+        src.val[k] = vorrq_u8(vorrq_u8(vqtbl4q_u8(table_lo, c), vqtbl4q_u8(table_hi, vsubq_u8(c, offset))), vcgeq_u8(c, high));
+        err = vorrq_u8(err, src.val[k]);
+      }
+      if (vmaxvq_u8(err) > 63) break;
+      uint8x16x3_t dst;
+      dst.val[0] = vorrq_u8(vshlq_n_u8(src.val[0], 2), vshrq_n_u8(src.val[1], 4));
+      dst.val[1] = vorrq_u8(vshlq_n_u8(src.val[1], 4), vshrq_n_u8(src.val[2], 2));
+      dst.val[2] = vorrq_u8(vshlq_n_u8(src.val[2], 6), src.val[3]);
+      vst3q_u8(out, dst);
+    }
+  }
+#endif
+
+  // 32 bit word path: four table lookups, invalid characters have bit 7 set
+  for (; inputLen - i >= 4; i += 4, out += 3) {
+    uint32_t d0 = b64_table(b64_dec_table, (unsigned char) input[i]);
+    uint32_t d1 = b64_table(b64_dec_table, (unsigned char) input[i + 1]);
+    uint32_t d2 = b64_table(b64_dec_table, (unsigned char) input[i + 2]);
+    uint32_t d3 = b64_table(b64_dec_table, (unsigned char) input[i + 3]);
+    if ((d0 | d1 | d2 | d3) & 0x80) break;
+    uint32_t v = (d0 << 18) | (d1 << 12) | (d2 << 6) | d3;
+    out[0] = v >> 16;
+    out[1] = v >> 8;
+    out[2] = v;
+  }
+  return i;
+}
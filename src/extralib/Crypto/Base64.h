@@ -6,6 +6,8 @@
 #ifndef _BASE64_H
 #define _BASE64_H
 
+#include <stddef.h>
+
 /* b64_alphabet:
  *     Description: Base64 alphabet table, a mapping between integers
  *           and base64 digits
@@ -77,4 +79,65 @@ int base64_enc_len(int inputLen);
  */
 int base64_dec_len(char *input, int inputLen);
 
+/* Base64Encoder:
+ *    Description:
+ *      Incremental encoder, the input may be fed in chunks of any size.
+ *      Up to two bytes are held back between calls, so the output is the
+ *      same as base64_encode over the concatenated input.
+ *    Usage:
+ *      out += enc.update(out, chunk, chunkLen);   // repeat
+ *      out += enc.final(out);
+ *    Notes:
+ *      update() writes at most updateLen(inputLen) characters,
+ *      final() at most 4. Neither writes a terminating NUL.
+ */
+class Base64Encoder {
+  public:
+    Base64Encoder() : _len(0) {}
+    void reset() { _len = 0; }
+    static size_t updateLen(size_t inputLen) { return (inputLen + 2) / 3 * 4; }
+    size_t update(char *output, const void *input, size_t inputLen);
+    size_t final(char *output);
+  private:
+    unsigned char _carry[3];
+    unsigned char _len;
+};
+
+/* Base64Decoder:
+ *    Description:
+ *      Incremental, validating decoder, the input may be fed in chunks of
+ *      any size (e.g. straight from websocket fragments).
+ *    Usage:
+ *      n = dec.update(out, chunk, chunkLen);      // repeat, n < 0 on error
+ *      n = dec.final(out);                        // n < 0 if truncated
+ *    Return value:
+ *      Number of bytes written, or -1 as soon as the input is invalid:
+ *      a character outside the alphabet, '=' anywhere but the end of a
+ *      group or data following the padding. Once failed, every call
+ *      returns -1 until reset().
+ *    Notes:
+ *      1. update() writes at most updateLen(inputLen) bytes, final() at most 2
+ *      2. output may alias input as long as it does not run ahead of it, so a
+ *         buffer can be decoded onto itself: feed buf + consumed and write to
+ *         buf + decoded. Decoded data never overtakes the characters read.
+ *      3. no terminating NUL is written
+ *      4. a final group without padding is accepted
+ */
+class Base64Decoder {
+  public:
+    Base64Decoder() { reset(); }
+    void reset() { _len = 0; _pad = 0; _done = false; _failed = false; }
+    bool failed() const { return _failed; }
+    static size_t updateLen(size_t inputLen) { return (inputLen + 3) / 4 * 3; }
+    int update(unsigned char *output, const char *input, size_t inputLen);
+    int final(unsigned char *output);
+  private:
+    int fail() { _failed = true; return -1; }
+    unsigned char _quad[4];
+    unsigned char _len;
+    unsigned char _pad;
+    bool _done;
+    bool _failed;
+};
+
 #endif // _BASE64_H
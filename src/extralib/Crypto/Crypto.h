@@ -202,28 +202,7 @@ class AES
         CIPHER_MODE _cipherMode;
 };
 
-#if defined ESP8266 || defined ESP32
-/**
- * ESP8266 and ESP32 specific true random number generator
- */
-class RNG
-{
-    public:
-        /**
-         * Fill the [dst] array with [length] random bytes
-         */
-        static void fill(uint8_t *dst, unsigned int length);
-        /**
-         * Get a random byte
-         */
-        static byte get();
-        /**
-         * Get a 32bit random number
-         */
-        static uint32_t getLong();
-    private:
-};
-#endif
+#include "RNG.h"
 
 
 #endif
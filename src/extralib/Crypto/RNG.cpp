@@ -0,0 +1,188 @@
+/**
+ * Random number service shared by the crypto code and IotLink.
+ * 
+ * ChaCha20 block function after RFC 7539 (D. J. Bernstein's ChaCha).
+ * 
+ */
+
+#include "RNG.h"
+
+#if defined ESP8266 || defined ESP32 || defined __linux__
+
+#include <string.h>
+
+#if defined ESP8266 || defined ESP32
+#include <Arduino.h>
+#else
+#include <sys/random.h>
+#endif
+
+#if defined ESP32
+static portMUX_TYPE rng_mux = portMUX_INITIALIZER_UNLOCKED;
+#define RNG_LOCK()      portENTER_CRITICAL(&rng_mux)
+#define RNG_UNLOCK()    portEXIT_CRITICAL(&rng_mux)
+#else
+#define RNG_LOCK()
+#define RNG_UNLOCK()
+#endif
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUND(a, b, c, d)                \
+{                                               \
+    a += b; d ^= a; d = ROTL32(d, 16);          \
+    c += d; b ^= c; b = ROTL32(b, 12);          \
+    a += b; d ^= a; d = ROTL32(d, 8);           \
+    c += d; b ^= c; b = ROTL32(b, 7);           \
+}
+
+static uint32_t rng_key[8];
+static uint8_t rng_pool[RNG_POOL_SIZE];
+static unsigned int rng_pool_pos = RNG_POOL_SIZE;
+static unsigned int rng_refills = 0;
+static bool rng_seeded = false;
+
+/**
+ * Compute the 64 byte ChaCha20 block [counter] for [key] with an all zero
+ * nonce, every key is only ever used for a single refill
+ */
+static void chacha20_block(const uint32_t key[8], uint32_t counter, uint8_t out[64])
+{
+    uint32_t input[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, // "expand 32-byte k"
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        counter, 0, 0, 0
+    };
+    uint32_t x[16];
+    memcpy(x, input, sizeof(x));
+
+    for (int i = 0; i < 10; i++)
+    {
+        QUARTERROUND(x[0], x[4], x[ 8], x[12]);
+        QUARTERROUND(x[1], x[5], x[ 9], x[13]);
+        QUARTERROUND(x[2], x[6], x[10], x[14]);
+        QUARTERROUND(x[3], x[7], x[11], x[15]);
+        QUARTERROUND(x[0], x[5], x[10], x[15]);
+        QUARTERROUND(x[1], x[6], x[11], x[12]);
+        QUARTERROUND(x[2], x[7], x[ 8], x[13]);
+        QUARTERROUND(x[3], x[4], x[ 9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        uint32_t v = x[i] + input[i];
+        out[4 * i    ] = (uint8_t) (v      );
+        out[4 * i + 1] = (uint8_t) (v >>  8);
+        out[4 * i + 2] = (uint8_t) (v >> 16);
+        out[4 * i + 3] = (uint8_t) (v >> 24);
+    }
+}
+
+/**
+ * One full 32bit read of the hardware RNG.
+ * 
+ * Acording to the ESP32 documentation, you should not call the tRNG 
+ * faster than 5MHz
+ */
+uint32_t RNG::hardware()
+{
+#if defined ESP32
+    return *(volatile uint32_t*) 0x3FF75144;
+#elif defined ESP8266
+    return *(volatile uint32_t*) 0x3FF20E44L;
+#else
+    uint32_t v = 0;
+    while (getrandom(&v, sizeof(v), 0) != sizeof(v)) {}
+    return v;
+#endif
+}
+
+void RNG::reseed()
+{
+    for (int i = 0; i < 8; i++)
+    {
+        rng_key[i] ^= hardware();
+    }
+    rng_seeded = true;
+    rng_refills = 0;
+}
+
+void RNG::refill()
+{
+    if (!rng_seeded || rng_refills >= RNG_RESEED_INTERVAL)
+    {
+        reseed();
+    }
+    rng_refills++;
+
+    uint8_t block[64];
+    unsigned int blocks = (sizeof(rng_key) + RNG_POOL_SIZE) / 64;
+    for (unsigned int i = 0; i < blocks; i++)
+    {
+        chacha20_block(rng_key, i, block);
+        if (i == 0)
+        {
+            // first 32 bytes become the next key, the rest is output
+            for (int k = 0; k < 8; k++)
+            {
+                rng_key[k] = (uint32_t) block[4 * k] | ((uint32_t) block[4 * k + 1] << 8) | 
+                             ((uint32_t) block[4 * k + 2] << 16) | ((uint32_t) block[4 * k + 3] << 24);
+            }
+            memcpy(rng_pool, block + 32, 32);
+        }
+        else
+        {
+            memcpy(rng_pool + 64 * i - 32, block, 64);
+        }
+    }
+    memset(block, 0, sizeof(block));
+    rng_pool_pos = 0;
+}
+
+void RNG::fill(uint8_t *dst, unsigned int length)
+{
+    RNG_LOCK();
+    while (length)
+    {
+        if (rng_pool_pos == RNG_POOL_SIZE)
+        {
+            refill();
+        }
+        unsigned int n = RNG_POOL_SIZE - rng_pool_pos;
+        if (n > length) n = length;
+        memcpy(dst, rng_pool + rng_pool_pos, n);
+        // served bytes are wiped so they cannot be recovered later
+        memset(rng_pool + rng_pool_pos, 0, n);
+        rng_pool_pos += n;
+        dst += n;
+        length -= n;
+    }
+    RNG_UNLOCK();
+}
+
+uint8_t RNG::get()
+{
+    uint8_t v;
+    fill(&v, 1);
+    return v;
+}
+
+uint32_t RNG::getLong()
+{
+    uint32_t v;
+    fill((uint8_t*) &v, sizeof(v));
+    return v;
+}
+
+void RNG::stir(const uint8_t *seed, unsigned int length)
+{
+    RNG_LOCK();
+    for (unsigned int i = 0; i < length; i++)
+    {
+        rng_key[(i / 4) % 8] ^= (uint32_t) seed[i] << (8 * (i % 4));
+    }
+    // drop what was generated with the old key
+    rng_pool_pos = RNG_POOL_SIZE;
+    RNG_UNLOCK();
+}
+#endif
@@ -0,0 +1,58 @@
+/**
+ * Random number service shared by the crypto code and IotLink.
+ * 
+ * A ChaCha20 key is seeded from the hardware RNG (full 32bit register reads
+ * on ESP8266 and ESP32, getrandom() on Linux hosts) and expanded into a small
+ * output pool, so callers no longer pay a register read per byte. The key is
+ * replaced from the stream on every refill (fast key erasure) and fresh
+ * hardware entropy is mixed in every RNG_RESEED_INTERVAL refills.
+ * 
+ */
+
+#ifndef RNG_h
+#define RNG_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// number of pool refills between two hardware reseeds
+#ifndef RNG_RESEED_INTERVAL
+#define RNG_RESEED_INTERVAL     16
+#endif
+
+// output bytes produced per refill, a multiple of 64 minus the 32 byte key
+#define RNG_POOL_SIZE           96
+
+#if defined ESP8266 || defined ESP32 || defined __linux__
+/**
+ * ChaCha20 based deterministic random bit generator on top of the
+ * hardware entropy source
+ */
+class RNG
+{
+    public:
+        /**
+         * Fill the [dst] array with [length] random bytes
+         */
+        static void fill(uint8_t *dst, unsigned int length);
+        /**
+         * Get a random byte
+         */
+        static uint8_t get();
+        /**
+         * Get a 32bit random number
+         */
+        static uint32_t getLong();
+        /**
+         * Mix [length] bytes of additional entropy from [seed] into the generator
+         */
+        static void stir(const uint8_t *seed, unsigned int length);
+    private:
+        static void refill();
+        static void reseed();
+        static uint32_t hardware();
+};
+#endif
+
+
+#endif